@@ -1,9 +1,15 @@
+#include "hal_crc.h"
 
 #include "hal_filesystem.h"
 #include "hal_netsys.h"
 #include "hal_poll.h"
+#include "hal_resolver.h"
 #include "hal_serial.h"
+#include "hal_serial_master.h"
 #include "hal_socket_dgram.h"
+#include "hal_socket_framer.h"
+#include "hal_socket_pool.h"
+#include "hal_socket_shm.h"
 #include "hal_socket_stream.h"
 #include "hal_thread.h"
 #include "hal_time.h"
@@ -0,0 +1,98 @@
+#ifndef HAL_CRC_H
+#define HAL_CRC_H
+
+
+#include "hal_base.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*! \addtogroup hal
+   *
+   *  @{
+   */
+
+/**
+ * @defgroup HAL_CRC Checksums for the serial and packet framing
+ *
+ * The checksums are computed by the slicing-by-8 tables (8 bytes per step).
+ * On x86 the CPU is checked at the first call: CRC-32C uses the SSE4.2 crc32
+ * instruction and CRC-32 uses the carry-less multiplication (PCLMULQDQ) for
+ * the buffers of 64 bytes and more.
+ *
+ * All functions take the value returned for the previous part of the data,
+ * so the checksum may be computed piece by piece.
+ *
+ * @{
+ */
+
+
+/** Initial value of CRC-16/MODBUS (the result is sent low byte first) */
+#define HAL_CRC16_MODBUS_INIT 0xFFFF
+
+/** Initial value of CRC-16/IBM (ARC) */
+#define HAL_CRC16_IBM_INIT 0x0000
+
+
+/**
+ * \brief Update CRC-16 with the reflected polynomial 0x8005 (IBM family)
+ *
+ * \param crc the initial value (HAL_CRC16_MODBUS_INIT, HAL_CRC16_IBM_INIT)
+ *  or the result of the previous call
+ * \param data the data
+ * \param size size of the data
+ *
+ * \return the checksum
+ */
+HAL_API uint16_t
+HalCrc_crc16(uint16_t crc, const void *data, size_t size);
+
+/**
+ * \brief Update CRC-32 (IEEE 802.3, zlib)
+ *
+ * \param crc 0 or the result of the previous call
+ * \param data the data
+ * \param size size of the data
+ *
+ * \return the checksum
+ */
+HAL_API uint32_t
+HalCrc_crc32(uint32_t crc, const void *data, size_t size);
+
+/**
+ * \brief Update CRC-32C (Castagnoli: iSCSI, SCTP, ext4)
+ *
+ * \param crc 0 or the result of the previous call
+ * \param data the data
+ * \param size size of the data
+ *
+ * \return the checksum
+ */
+HAL_API uint32_t
+HalCrc_crc32c(uint32_t crc, const void *data, size_t size);
+
+/**
+ * \brief Allow or forbid the CPU instructions (all threads)
+ *
+ * The instructions are allowed by default. Forbidding them is useful for the comparison only.
+ *
+ * \return true if the instructions are used
+ */
+HAL_API bool
+HalCrc_setHardware(bool enable);
+
+
+/*! @} */
+
+/*! @} */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* HAL_CRC_H */
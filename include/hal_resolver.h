@@ -0,0 +1,126 @@
+#ifndef HAL_RESOLVER_H
+#define HAL_RESOLVER_H
+
+
+#include "hal_base.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*! \addtogroup hal
+   *
+   *  @{
+   */
+
+/**
+ * @defgroup HAL_RESOLVER Asynchronous host name resolver with cache
+ *
+ * The socket functions resolve host names synchronously (getaddrinfo) and may block
+ * for seconds on a slow resolver. HalResolver resolves names in the background thread
+ * and keeps the results for the given time, so the event loop passes numeric
+ * addresses to the sockets and never blocks on DNS. Alternatively the resolver may be
+ * installed for the socket functions (\ref HalResolver_setSocketResolver).
+ *
+ * @{
+ */
+
+
+/** Opaque reference for a resolver instance */
+typedef struct sHalResolver *HalResolver;
+
+/** Result of \ref HalResolver_lookup */
+typedef enum {
+	HAL_RESOLVE_DONE,		//!< the address is ready
+	HAL_RESOLVE_PENDING,	//!< resolution is in progress: wait for the descriptor
+	HAL_RESOLVE_FAILED		//!< the name can not be resolved (reported once) or the cache is full
+} HalResolveState;
+
+/** Size of the buffer for the resolved address (IPv6 string) */
+#define HAL_RESOLVER_ADDRESS_SIZE 48
+
+
+/**
+ * \brief Create a new resolver instance and start its thread
+ *
+ * \param maxEntries maximum number of the cached names
+ * \param ttlInMs time to keep the resolved address
+ *
+ * \return the newly created HalResolver instance
+ */
+HAL_API HalResolver
+HalResolver_create(int maxEntries, uint32_t ttlInMs);
+
+/**
+ * \brief Get the address of the host (non-blocking)
+ *
+ * Numeric addresses are returned at once. A name missing in the cache is queued for
+ * the background resolution. An expired address is still returned while the name
+ * is resolved again.
+ *
+ * \param self the resolver instance
+ * \param host host name or numeric address
+ * \param address buffer for the address (HAL_RESOLVER_ADDRESS_SIZE bytes)
+ *
+ * \return state of the resolution
+ */
+HAL_API HalResolveState
+HalResolver_lookup(HalResolver self, const char *host, char *address);
+
+/**
+ * \brief Get the descriptor that becomes readable when a background resolution is finished (HAL_POLLIN)
+ */
+HAL_API unidesc
+HalResolver_getDescriptor(HalResolver self);
+
+/**
+ * \brief Clear the descriptor event (before new lookups of the pending names)
+ */
+HAL_API void
+HalResolver_endEvent(HalResolver self);
+
+/**
+ * \brief Drop all cached addresses
+ */
+HAL_API void
+HalResolver_flush(HalResolver self);
+
+/**
+ * \brief Resolve the host names passed to the socket functions by the resolver
+ *
+ * The socket functions (connect, bind, the remote address of the datagram socket)
+ * take the address from the resolver cache instead of calling getaddrinfo. While the
+ * name is being resolved they fail at once with errno EWOULDBLOCK (WSAEWOULDBLOCK on
+ * Windows): repeat the call when the resolver descriptor is signaled.
+ *
+ * Install the resolver before the sockets are used by other threads.
+ *
+ * \param self the resolver instance or NULL to resolve the names synchronously (default)
+ */
+HAL_API void
+HalResolver_setSocketResolver(HalResolver self);
+
+/**
+ * \brief Stop the thread and release the resources
+ *
+ * Waits for the current resolution to finish. The resolver installed for the socket
+ * functions must be uninstalled first (\ref HalResolver_setSocketResolver with NULL) while
+ * no socket function is running in other threads: they use it without locking.
+ */
+HAL_API void
+HalResolver_destroy(HalResolver self);
+
+
+/*! @} */
+
+/*! @} */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* HAL_RESOLVER_H */
@@ -3,6 +3,7 @@
 
 
 #include "hal_base.h"
+#include "hal_poll.h"
 
 
 #ifdef __cplusplus
@@ -29,6 +30,19 @@ extern "C" {
 
 typedef struct sSerialPort* SerialPort;
 
+/** RS-485 direction control by the driver (see \ref SerialPort_setRs485) */
+typedef struct {
+	bool enabled;
+	bool rtsOnSend;					//!< RTS level while sending (true - high)
+	bool rtsAfterSend;				//!< RTS level after sending
+	bool rxDuringTx;				//!< receive own transmission (echo)
+	uint32_t delayBeforeSendInMs;	//!< delay from RTS switch to the first bit
+	uint32_t delayAfterSendInMs;	//!< delay from the last bit to RTS switch
+} SerialPortRs485;
+
+/** Callback for the transmission completion of the queued data (see \ref SerialPort_attachTxQueue) */
+typedef void (*SerialPortTxHandler)(void *user, SerialPort port);
+
 typedef enum {
 	SERIAL_PORT_ERROR_NONE = 0,
 	SERIAL_PORT_ERROR_INVALID_ARGUMENT = 1,
@@ -48,10 +62,28 @@ typedef enum {
 HAL_API SerialPort
 SerialPort_create(const char *interfaceName);
 
+/**
+ * \brief Create two open SerialPort instances connected to each other (pseudo terminal pair, linux only)
+ *
+ * The ports behave like the ones created by \ref SerialPort_create and opened by \ref SerialPort_open
+ * with the default settings (9600 8N1). \ref SerialPort_reinit and \ref SerialPort_open apply the new
+ * settings to the pair keeping it connected. The descriptors are closed by \ref SerialPort_destroy.
+ *
+ * \param first the first port
+ * \param second the second port
+ * \param simulateLine deliver the data written by \ref SerialPort_write at the baud rate of the writer
+ *  (the write returns when the data is transmitted) instead of at once
+ *
+ * \return true in case of success, false otherwise
+ */
+HAL_API bool
+SerialPort_createPtyPair(SerialPort *first, SerialPort *second, bool simulateLine);
+
 /**
  * \brief Reinit SerialPort
  *
- * \param baudRate the baud rate in baud (e.g. 9600)
+ * \param baudRate the baud rate in baud (e.g. 9600). Non-standard rates are set
+ *  by the driver divisor (linux: termios2 BOTHER); the open fails if the driver rejects the rate
  * \param dataBits the number of data bits (usually 8)
  * \param parity defines what kind of parity to use ('E' - even parity, 'O' - odd parity, 'N' - no parity)
  * \param stopBits the number of stop buts (usually 1)
@@ -122,6 +154,106 @@ SerialPort_readByte(SerialPort self);
 HAL_API int
 SerialPort_read(SerialPort self, uint8_t *buffer, int numberOfBytes);
 
+/**
+ * \brief Read the bytes available in the input buffer at once
+ *
+ * Waits for the first byte up to the timeout (see \ref SerialPort_setTimeout),
+ * then returns all available bytes (up to numberOfBytes) without waiting for more.
+ *
+ * \param buffer the buffer containing the data after read
+ * \param numberOfBytes number of bytes available in the buffer
+ *
+ * \return number of bytes read, 0 in case of the timeout, or -1 in case of an error
+ */
+HAL_API int
+SerialPort_readBulk(SerialPort self, uint8_t *buffer, int numberOfBytes);
+
+/**
+ * \brief Set the inter-character gap that delimits the frames (see \ref SerialPort_readFrame)
+ *
+ * \param gapInUs silence time in microseconds, 0 - t3.5 of Modbus RTU computed from
+ *  the baud rate and the character format (1750 us above 19200 baud)
+ */
+HAL_API void
+SerialPort_setFrameGap(SerialPort self, int gapInUs);
+
+/**
+ * \brief Get the inter-character gap in microseconds used by \ref SerialPort_readFrame
+ *
+ * \return the configured gap or the computed t3.5 if it is not configured, -1 in case of an error
+ */
+HAL_API int
+SerialPort_getFrameGap(SerialPort self);
+
+/**
+ * \brief Read one frame delimited by the silence on the line
+ *
+ * Waits for the first byte up to the timeout (see \ref SerialPort_setTimeout),
+ * then reads the bytes until the line is silent for the frame gap (see \ref SerialPort_setFrameGap).
+ * The rest of the frame that does not fit into the buffer is discarded.
+ *
+ * \param buffer the buffer for the frame
+ * \param numberOfBytes size of the buffer
+ * \param timestampInNs monotonic time (see \ref Hal_getMonotonicTimeInNs) of the reception
+ *  of the first bytes of the frame (may be NULL)
+ *
+ * \return size of the frame, 0 in case of the timeout, or -1 in case of an error
+ */
+HAL_API int
+SerialPort_readFrame(SerialPort self, uint8_t *buffer, int numberOfBytes, uint64_t *timestampInNs);
+
+/**
+ * \brief Start the background reception into the receive ring
+ *
+ * A thread reads the bytes as soon as they arrive and stores them in a lock-free ring
+ * together with the arrival time of each chunk, so the timing is kept while the application is busy.
+ * If the ring is full the bytes are kept in the driver buffer until the ring is consumed.
+ * While the ring is active the other read functions fail; it is stopped by
+ * \ref SerialPort_stopRxRing, \ref SerialPort_close and \ref SerialPort_reinit.
+ * The ring must be consumed by one thread.
+ *
+ * \param size size of the ring in bytes (rounded up to a power of two)
+ *
+ * \return true in case of success, false otherwise
+ */
+HAL_API bool
+SerialPort_startRxRing(SerialPort self, int size);
+
+/**
+ * \brief Stop the background reception: the data left in the ring is discarded
+ */
+HAL_API void
+SerialPort_stopRxRing(SerialPort self);
+
+/**
+ * \brief Get the descriptor that is readable (HAL_POLLIN) while there is data in the receive ring
+ *
+ * The event is cleared by \ref SerialPort_peekRxRing when the ring is empty.
+ */
+HAL_API unidesc
+SerialPort_getRxRingDescriptor(SerialPort self);
+
+/**
+ * \brief Get the oldest received data in the ring without copying
+ *
+ * Returns the contiguous part of the oldest chunk: the bytes received by one read of the driver
+ * (split at the end of the ring).
+ *
+ * \param data pointer to the data in the ring, valid until \ref SerialPort_consumeRxRing
+ * \param timestampInNs monotonic time (see \ref Hal_getMonotonicTimeInNs) of the chunk reception (may be NULL)
+ *
+ * \return number of bytes, 0 if the ring is empty, or -1 in case of an error
+ *  (the ring is not started, or the port is hung up and the ring is empty)
+ */
+HAL_API int
+SerialPort_peekRxRing(SerialPort self, const uint8_t **data, uint64_t *timestampInNs);
+
+/**
+ * \brief Release the bytes read from the ring (up to the number of bytes in the ring)
+ */
+HAL_API void
+SerialPort_consumeRxRing(SerialPort self, int size);
+
 /**
  * \brief Write the number of bytes from the buffer to the serial interface
  *
@@ -139,6 +271,118 @@ SerialPort_write(SerialPort self, uint8_t *buffer, int numberOfBytes);
 HAL_API int
 SerialPort_writeAndWait(SerialPort self, uint8_t *buffer, int numberOfBytes);
 
+/**
+ * \brief Enable the low latency mode of the driver (linux: ASYNC_LOW_LATENCY)
+ *
+ * The driver pushes the received bytes to the application at once instead of batching them.
+ * The mode is applied at open (best effort) and at once if the port is open.
+ * Combine with \ref SerialPort_setLatencyTimer for USB adapters.
+ *
+ * \return true in case of success, false if the driver does not support it
+ */
+HAL_API bool
+SerialPort_setLowLatency(SerialPort self, bool enable);
+
+/**
+ * \brief Set the receive latency timer of the USB serial adapter (FTDI: 16 ms by default)
+ *
+ * linux: written to the latency_timer attribute of the usb-serial device in sysfs
+ * (the process needs write access to it).
+ *
+ * \param timeInMs the timer value (1..255 ms)
+ *
+ * \return true in case of success, false if the adapter has no such timer
+ */
+HAL_API bool
+SerialPort_setLatencyTimer(SerialPort self, int timeInMs);
+
+/**
+ * \brief Set the RS-485 mode: the driver toggles the transmitter enable (RTS) around each transmission
+ *
+ * The turnaround is done by the driver (linux: TIOCSRS485), the write calls do not wait for it.
+ * The configuration is applied at once if the port is open and at every open:
+ * the open fails if the driver does not support RS-485.
+ *
+ * Windows: RTS toggle mode (RTS_CONTROL_TOGGLE), the delays and the levels are not supported.
+ *
+ * \param config the RS-485 configuration (enabled false - RS-232 mode)
+ *
+ * \return true in case of success, false otherwise
+ */
+HAL_API bool
+SerialPort_setRs485(SerialPort self, const SerialPortRs485 *config);
+
+/**
+ * \brief Attach the transmit queue drained by the HalPoll (non-blocking output)
+ *
+ * \ref SerialPort_writeAsync writes what the driver accepts and queues the rest, the queue
+ * is drained on HAL_POLLOUT. When the queue and the driver output buffer (TIOCOUTQ) are empty
+ * and the transmitter is idle, the handler is called: e.g. to turn the half-duplex line around.
+ *
+ * A duplicate of the port descriptor and a timer are added to the poll, so the port
+ * descriptor itself may be polled for input by the application.
+ * All calls must be done in the thread of the HalPoll. The queue is detached by \ref SerialPort_close.
+ *
+ * \param poll the HalPoll instance
+ * \param queueSize size of the queue in bytes
+ * \param user user data for the handler
+ * \param handler the transmission completion handler (may be NULL)
+ *
+ * \return true in case of success, false otherwise
+ */
+HAL_API bool
+SerialPort_attachTxQueue(SerialPort self, HalPoll poll, int queueSize, void *user, SerialPortTxHandler handler);
+
+/**
+ * \brief Detach the transmit queue: the queued data is dropped
+ */
+HAL_API void
+SerialPort_detachTxQueue(SerialPort self);
+
+/**
+ * \brief Write the data via the transmit queue without blocking (see \ref SerialPort_attachTxQueue)
+ *
+ * \param buffer the buffer containing the data to write
+ * \param numberOfBytes number of bytes to write
+ *
+ * \return numberOfBytes in case of success, 0 if the queue has no room for the whole data,
+ *  or -1 in case of an error
+ */
+HAL_API int
+SerialPort_writeAsync(SerialPort self, const uint8_t *buffer, int numberOfBytes);
+
+/**
+ * \brief Get the number of bytes not transmitted yet (the transmit queue and the driver buffer)
+ *
+ * \return number of bytes or -1 in case of an error
+ */
+HAL_API int
+SerialPort_getTxPending(SerialPort self);
+
+/**
+ * \brief Start the capture of the received and transmitted data into the pcapng file
+ *
+ * The read and write functions copy the data with the monotonic timestamp into a buffer
+ * (one per direction, the writers of the same direction are serialised by a spin lock) and
+ * a thread writes it into the file, so the capture adds a copy to the I/O path only. The
+ * data is written as packets of the link type USER0 (147) with the direction flag: the
+ * payload dissector is set in Wireshark (DLT_USER, e.g. mbrtu).
+ * If the buffer is full the data is not captured. The capture may be started and stopped
+ * while the port is used by other threads.
+ *
+ * \param filename path of the file (overwritten)
+ *
+ * \return true in case of success, false otherwise
+ */
+HAL_API bool
+SerialPort_startCapture(SerialPort self, const char *filename);
+
+/**
+ * \brief Stop the capture: the buffered data is written and the file is closed
+ */
+HAL_API void
+SerialPort_stopCapture(SerialPort self);
+
 /**
  * \brief Get the error code of the last operation
  */
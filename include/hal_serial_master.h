@@ -0,0 +1,137 @@
+#ifndef HAL_SERIAL_MASTER_H
+#define HAL_SERIAL_MASTER_H
+
+
+#include "hal_base.h"
+#include "hal_poll.h"
+#include "hal_serial.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*! \addtogroup hal
+   *
+   *  @{
+   */
+
+/**
+ * @defgroup HAL_SERIAL_MASTER Request/response scheduler for many serial lines
+ *
+ * The master drives any number of open serial ports from one HalPoll thread.
+ * Each port (line) has its own queue of requests: a request is sent when the previous
+ * one is answered, failed or timed out, so all lines work concurrently without
+ * a thread per port. The response is delimited by the frame gap of the port
+ * (see \ref SerialPort_setFrameGap) or by the expected response size.
+ * The request that does not fit into the driver output buffer is written in parts
+ * when the port becomes writable.
+ *
+ * When the port is hung up (e.g. the USB adapter is unplugged) it is removed from
+ * the poll and its requests are completed with SERIAL_MASTER_ERROR. New requests to
+ * the port are refused until it is removed from the master.
+ *
+ * All calls must be done in the thread of the HalPoll.
+ *
+ * @{
+ */
+
+
+/** Opaque reference for a serial master instance */
+typedef struct sSerialMaster *SerialMaster;
+
+/** Maximum size of the request and the response */
+#define SERIAL_MASTER_FRAME_SIZE 256
+
+/** Result of a request */
+typedef enum {
+	SERIAL_MASTER_OK,			//!< the response is received (empty for requests without a response)
+	SERIAL_MASTER_TIMEOUT,		//!< no response after all retries or the request is not transmitted in time
+	SERIAL_MASTER_ERROR,		//!< the request can not be sent or the port is hung up
+	SERIAL_MASTER_CANCELLED		//!< the port is removed from the master
+} SerialMasterResult;
+
+/** Callback for the request completion: the response is valid during the call only */
+typedef void (*SerialMasterHandler)(void *user, SerialPort port, SerialMasterResult result, const uint8_t *response, int size);
+
+
+/**
+ * \brief Create a new serial master instance
+ *
+ * \param poll the HalPoll instance that drives the lines
+ *
+ * \return the newly created SerialMaster instance
+ */
+HAL_API SerialMaster
+SerialMaster_create(HalPoll poll);
+
+/**
+ * \brief Add the open serial port to the master
+ *
+ * The port descriptor and a timer are added to the poll. The port read timeout is set to 0.
+ *
+ * \param self the master instance
+ * \param port the open serial port
+ * \param queueLength maximum number of the queued requests of the port
+ *
+ * \return true in case of success, false otherwise
+ */
+HAL_API bool
+SerialMaster_addPort(SerialMaster self, SerialPort port, int queueLength);
+
+/**
+ * \brief Remove the port from the master: the queued requests are completed with SERIAL_MASTER_CANCELLED
+ *
+ * Must not be called from the completion handler of the same port.
+ */
+HAL_API void
+SerialMaster_removePort(SerialMaster self, SerialPort port);
+
+/**
+ * \brief Queue the request to the port
+ *
+ * \param self the master instance
+ * \param port the port added by \ref SerialMaster_addPort
+ * \param request the request data (copied)
+ * \param size size of the request (up to SERIAL_MASTER_FRAME_SIZE)
+ * \param expectedSize size of the response if it is known (the gap is not waited), 0 - delimited by the gap
+ * \param timeoutInMs time to wait for the response after the request is transmitted,
+ *  0 - no response is expected (broadcast): completed after the transmission and the frame gap
+ * \param retries number of the repeated requests on timeout
+ * \param user user data for the handler
+ * \param handler the completion handler (may be NULL)
+ *
+ * \return true if the request is queued, false if the queue is full, the port is hung up
+ *  or the arguments are invalid
+ */
+HAL_API bool
+SerialMaster_request(SerialMaster self, SerialPort port, const uint8_t *request, int size,
+		int expectedSize, int timeoutInMs, int retries, void *user, SerialMasterHandler handler);
+
+/**
+ * \brief Get the number of the queued requests of the port (including the active one)
+ *
+ * \return number of requests or -1 if the port is not added
+ */
+HAL_API int
+SerialMaster_getQueued(SerialMaster self, SerialPort port);
+
+/**
+ * \brief Remove all ports and release the resources
+ */
+HAL_API void
+SerialMaster_destroy(SerialMaster self);
+
+
+/*! @} */
+
+/*! @} */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* HAL_SERIAL_MASTER_H */
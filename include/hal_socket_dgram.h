@@ -31,7 +31,7 @@ typedef union uDgramSocketAddress *DgramSocketAddress;
 
 union uDgramSocketAddress {
 	struct {
-		char ip[16];
+		char ip[48];	// IPv4 or IPv6 (INET6_ADDRSTRLEN)
 		uint16_t port;
 	};
 	uint8_t mac[6];
@@ -49,6 +49,9 @@ union uDgramSocketAddress {
 /**
  * \brief Create a UDP socket and bind to system socket
  *
+ * The address family follows the address: NULL - any IPv4 address,
+ * "::" - any IPv6 address (dual-stack: IPv4 datagrams are received too).
+ *
  * \param ip ip v4/v6 address or hostname
  * \param port udp port
  *
@@ -68,6 +71,10 @@ UdpDgramSocket_create(void);
 /**
  * \brief Bind a UDP socket to system socket
  *
+ * The address must be of the socket family: an IPv6 address fails for the IPv4 socket
+ * (\ref UdpDgramSocket_create), IPv4 is accepted by the dual-stack IPv6 socket.
+ * Use \ref UdpDgramSocket_createAndBind to get the IPv6 socket.
+ *
  * \param self the socket instance
  * \param ip ip v4/v6 address or hostname
  * \param port udp port
@@ -81,7 +88,7 @@ UdpDgramSocket_bind(DgramSocket self, const char *ip, uint16_t port);
  * \brief The socket joins to the UDP group (multicast)
  *
  * \param self the socket instance
- * \param ip ip v4 of the group
+ * \param ip ip v4/v6 of the group (v6 group requires IPv6 socket)
  * \param iface the ID of the Ethernet interface (number, name or ip address on the interface)
  *
  * \return true in case of success, false otherwise
@@ -203,6 +210,10 @@ DgramSocket_reset(DgramSocket self);
 /**
  * \brief Set remote partner for massage exchanging (read/write filter)
  *
+ * The address is parsed once here and is used by the following writes. A name pending
+ * in the socket resolver (\ref HalResolver_setSocketResolver) is parsed by the writes
+ * until it is resolved.
+ *
  * \param self the socket instance
  * \param addr destination address (protocol specific)
  */
@@ -243,7 +254,9 @@ DgramSocket_read(DgramSocket self, uint8_t *buf, int size);
 /**
  * \brief Send a message through the socket to remote partner
  *
- * Destination address must be assigned via \ref DgramSocket_setRemote.
+ * Destination address must be assigned via \ref DgramSocket_setRemote. While the name of
+ * the remote partner is resolved by the socket resolver the function fails with errno
+ * EWOULDBLOCK.
  *
  * \param self the socket instance
  * \param buf data to send
@@ -270,6 +283,40 @@ DgramSocket_write(DgramSocket self, const uint8_t *buf, int size);
 HAL_API int
 DgramSocket_readFrom(DgramSocket self, DgramSocketAddress addr, uint8_t *buf, int size);
 
+/**
+ * \brief Read one datagram from remote partner only (non-blocking)
+ *
+ * Acts like \ref DgramSocket_read without \ref DgramSocket_readAvailable call:
+ * the datagrams from other sources are dropped after the reception.
+ *
+ * \param self the socket instance
+ * \param buf the buffer where the read bytes are copied to
+ * \param size the maximum number of bytes to read (size of the provided buffer)
+ * \param fullSize storage for the real size of the datagram (may be NULL).
+ *  If it is greater than the return value the datagram was truncated
+ *
+ * \return the number of bytes read, 0 if no data is available or -1 if an error occurred
+ */
+HAL_API int
+DgramSocket_receive(DgramSocket self, uint8_t *buf, int size, int *fullSize);
+
+/**
+ * \brief Read one datagram (non-blocking)
+ *
+ * Acts like \ref DgramSocket_readFrom and reports the real size of the datagram
+ * (linux: MSG_TRUNC) instead of \ref DgramSocket_readAvailable call.
+ *
+ * \param self the socket instance
+ * \param addr address of data source (protocol specific). May be NULL
+ * \param buf the buffer where the read bytes are copied to
+ * \param size the maximum number of bytes to read (size of the provided buffer)
+ * \param fullSize storage for the real size of the datagram (may be NULL)
+ *
+ * \return the number of bytes read, 0 if no data is available or -1 if an error occurred
+ */
+HAL_API int
+DgramSocket_receiveFrom(DgramSocket self, DgramSocketAddress addr, uint8_t *buf, int size, int *fullSize);
+
 /**
  * \brief Send a message through the socket
  *
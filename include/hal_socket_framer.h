@@ -0,0 +1,147 @@
+#ifndef HAL_SOCKET_FRAMER_H
+#define HAL_SOCKET_FRAMER_H
+
+
+#include "hal_base.h"
+#include "hal_socket_stream.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*! \addtogroup hal
+   *
+   *  @{
+   */
+
+/**
+ * @defgroup HAL_SOCKET_FRAMER Message framing over the stream sockets
+ *
+ * The framer reads the stream into a ring buffer and splits it into messages.
+ * Messages are returned as views into the ring buffer (without copying).
+ *
+ * Example:
+ * 		StreamFramerConfig cfg = { .type = STREAM_FRAMER_FIXED, .lengthSize = 2, .bigEndian = true };
+ * 		StreamFramer f = StreamFramer_create(&cfg, 65536);
+ * 		// ... on HAL_POLLIN
+ * 		StreamFramer_receive(f, socket);
+ * 		const uint8_t *msg;
+ * 		uint32_t size;
+ * 		while (StreamFramer_next(f, &msg, &size)) {
+ * 			// handle msg
+ * 		}
+ *
+ * @{
+ */
+
+
+/** Opaque reference for a framer instance */
+typedef struct sStreamFramer *StreamFramer;
+
+/** Type of the message header */
+typedef enum {
+	STREAM_FRAMER_FIXED = 0,	/* fixed-size length field before the payload */
+	STREAM_FRAMER_VARINT,		/* LEB128 varint length before the payload */
+	STREAM_FRAMER_DELIMITER,	/* the payload is terminated by the delimiter sequence */
+} StreamFramerType;
+
+typedef struct {
+	StreamFramerType type;
+	/* STREAM_FRAMER_FIXED */
+	uint8_t lengthSize;			/* size of the length field: 1, 2 or 4 */
+	bool bigEndian;				/* byte order of the length field */
+	int lengthAdjust;			/* added to the length field to get the payload size
+								   (e.g. -lengthSize if the field includes itself) */
+	/* STREAM_FRAMER_DELIMITER */
+	uint8_t delimiter[8];
+	uint8_t delimiterSize;		/* 1..8 */
+	/* all */
+	uint32_t maxMessageSize;	/* maximum payload size (0 - limited by the buffer size) */
+} StreamFramerConfig;
+
+
+/**
+ * \brief Create a new StreamFramer instance
+ *
+ * \param config header format
+ * \param bufferSize ring buffer size (rounded up to the page size on linux). Must fit
+ *  the largest message with its header
+ *
+ * \return the newly created StreamFramer instance
+ */
+HAL_API StreamFramer
+StreamFramer_create(const StreamFramerConfig *config, uint32_t bufferSize);
+
+/**
+ * \brief Read the available data from the socket to the ring buffer (non-blocking)
+ *
+ * Only one \ref ClientSocket_receive call is done, it fills all free space of the buffer.
+ *
+ * \return the number of bytes read, 0 if no data is available or the buffer is full,
+ *  -1 if an error occurred or the peer closed the connection
+ */
+HAL_API int
+StreamFramer_receive(StreamFramer self, ClientSocket socket);
+
+/**
+ * \brief Get the free space of the ring buffer for the data from other sources
+ *
+ * \param size storage for the size of the contiguous free space
+ *
+ * \return pointer to the free space; \ref StreamFramer_commit must be called after the write
+ */
+HAL_API uint8_t *
+StreamFramer_getWriteBuffer(StreamFramer self, uint32_t *size);
+
+/**
+ * \brief Commit the data written to \ref StreamFramer_getWriteBuffer
+ */
+HAL_API void
+StreamFramer_commit(StreamFramer self, uint32_t size);
+
+/**
+ * \brief Get the next complete message
+ *
+ * The message returned by the previous call is released. The view is valid until
+ * the next call of this function, \ref StreamFramer_reset or \ref StreamFramer_destroy.
+ *
+ * \param data storage for the payload pointer
+ * \param size storage for the payload size
+ *
+ * \return true if the message is available, false otherwise (no complete message or an error)
+ */
+HAL_API bool
+StreamFramer_next(StreamFramer self, const uint8_t **data, uint32_t *size);
+
+/**
+ * \brief Check the stream for a framing error (message is too long or malformed header)
+ */
+HAL_API bool
+StreamFramer_isBroken(StreamFramer self);
+
+/**
+ * \brief Drop all buffered data and clear the error state
+ */
+HAL_API void
+StreamFramer_reset(StreamFramer self);
+
+/**
+ * \brief Destroy the StreamFramer instance
+ */
+HAL_API void
+StreamFramer_destroy(StreamFramer self);
+
+
+/*! @} */
+
+/*! @} */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* HAL_SOCKET_FRAMER_H */
@@ -0,0 +1,99 @@
+#ifndef HAL_SOCKET_POOL_H
+#define HAL_SOCKET_POOL_H
+
+
+#include "hal_base.h"
+#include "hal_socket_stream.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*! \addtogroup hal
+   *
+   *  @{
+   */
+
+/**
+ * @defgroup HAL_SOCKET_POOL Pool of the outbound TCP connections
+ *
+ * @{
+ */
+
+
+/** Opaque reference for a socket pool instance */
+typedef struct sClientSocketPool *ClientSocketPool;
+
+
+/**
+ * \brief Create a new ClientSocketPool instance
+ *
+ * \param maxPerAddress maximum number of the connections (idle and in use) to one server address
+ *
+ * \return the newly created ClientSocketPool instance
+ */
+HAL_API ClientSocketPool
+ClientSocketPool_create(int maxPerAddress);
+
+/**
+ * \brief Get a connection to the server (non-blocking)
+ *
+ * An idle connection to the address is checked (any input, hang up or error means
+ * the connection is closed by the peer or broken) and returned. Broken connections
+ * are destroyed. If there is no idle connection a new TCP socket is created and
+ * connected by \ref ClientSocket_connectAsync: such socket may still be connecting,
+ * use \ref ClientSocket_checkConnectState or poll it for HAL_POLLOUT.
+ *
+ * \param self the pool instance
+ * \param address remote server address
+ *
+ * \return the client socket or NULL if the limit for the address is reached or an error occurred
+ */
+HAL_API ClientSocket
+ClientSocketPool_get(ClientSocketPool self, const ClientSocketAddress address);
+
+/**
+ * \brief Return the connection to the pool
+ *
+ * \param self the pool instance
+ * \param socket the socket returned by \ref ClientSocketPool_get
+ * \param reuse true - keep the connection for the next \ref ClientSocketPool_get;
+ *  false - destroy the connection (e.g. after an error)
+ */
+HAL_API void
+ClientSocketPool_release(ClientSocketPool self, ClientSocket socket, bool reuse);
+
+/**
+ * \brief Get the number of the connections (idle and in use) to the server
+ */
+HAL_API int
+ClientSocketPool_getNumber(ClientSocketPool self, const ClientSocketAddress address);
+
+/**
+ * \brief Get the number of the idle connections to the server
+ */
+HAL_API int
+ClientSocketPool_getIdleNumber(ClientSocketPool self, const ClientSocketAddress address);
+
+/**
+ * \brief Destroy the pool instance and all idle connections
+ *
+ * All connections in use must be released before!
+ */
+HAL_API void
+ClientSocketPool_destroy(ClientSocketPool self);
+
+
+/*! @} */
+
+/*! @} */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* HAL_SOCKET_POOL_H */
@@ -0,0 +1,127 @@
+#ifndef HAL_SOCKET_SHM_H
+#define HAL_SOCKET_SHM_H
+
+
+#include "hal_base.h"
+#include "hal_socket_stream.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*! \addtogroup hal
+   *
+   *  @{
+   */
+
+/**
+ * @defgroup HAL_SOCKET_SHM Shared memory message transport between local processes (linux only)
+ *
+ * Two single producer / single consumer rings (one per direction) are placed
+ * into the shared memory. A message is written and read without system calls,
+ * the receiver is woken up via the eventfd only when its ring was empty.
+ *
+ * The shared memory and the doorbells are passed to the peer process over
+ * an already connected local stream socket (see \ref LocalClientSocket_create):
+ * one side calls \ref ShmSocket_create, the other one \ref ShmSocket_open.
+ * The local socket may be destroyed after that.
+ *
+ * Each side must be used by one reading and one writing thread at most.
+ *
+ * The receiver checks every record written by the peer: a record that does not fit
+ * into the ring breaks the channel, the read functions return -1 after that.
+ *
+ * @{
+ */
+
+
+/** Opaque reference for a shared memory socket instance */
+typedef struct sShmSocket *ShmSocket;
+
+
+/**
+ * \brief Create a new shared memory channel and pass it to the peer
+ *
+ * \param channel connected local client socket
+ * \param ringSize size of each of the rings in bytes (rounded up to the power of 2)
+ *
+ * \return the newly created ShmSocket instance or NULL if an error occurred
+ */
+HAL_API ShmSocket
+ShmSocket_create(ClientSocket channel, uint32_t ringSize);
+
+/**
+ * \brief Attach to the shared memory channel created by the peer with \ref ShmSocket_create
+ *
+ * \param channel connected local client socket
+ * \param timeoutInMs timeout to wait the channel from the peer
+ *
+ * \return the newly created ShmSocket instance or NULL if an error occurred
+ */
+HAL_API ShmSocket
+ShmSocket_open(ClientSocket channel, uint32_t timeoutInMs);
+
+/**
+ * \brief Send a message to the peer (non-blocking)
+ *
+ * \param self the socket instance
+ * \param buf the message
+ * \param size the message size (from 1 byte up to the quarter of the ring size)
+ *
+ * \return size in case of success, 0 if the ring is full,
+ *  -1 if the message is empty or too long or the peer closed the channel
+ */
+HAL_API int
+ShmSocket_write(ShmSocket self, const uint8_t *buf, int size);
+
+/**
+ * \brief Get the size of the next message without system calls
+ *
+ * \return the message size, 0 if there is no message or -1 if the peer closed
+ *  (or corrupted) the channel
+ */
+HAL_API int
+ShmSocket_readAvailable(ShmSocket self);
+
+/**
+ * \brief Read the next message from the peer (non-blocking)
+ *
+ * The message that does not fit into the buffer is truncated.
+ * The descriptor is cleared when the ring is empty: read the messages until 0 is returned.
+ *
+ * \param self the socket instance
+ * \param buf the buffer where the message is copied to
+ * \param size the size of the provided buffer
+ *
+ * \return the number of bytes read, 0 if there is no message
+ *  or -1 if the peer closed the channel (and all messages are read) or corrupted it
+ */
+HAL_API int
+ShmSocket_read(ShmSocket self, uint8_t *buf, int size);
+
+/**
+ * \brief Get the descriptor that becomes readable when new messages arrive (HAL_POLLIN)
+ */
+HAL_API unidesc
+ShmSocket_getDescriptor(ShmSocket self);
+
+/**
+ * \brief Close the channel and release the resources
+ */
+HAL_API void
+ShmSocket_destroy(ShmSocket self);
+
+
+/*! @} */
+
+/*! @} */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* HAL_SOCKET_SHM_H */
@@ -3,6 +3,7 @@
 
 
 #include "hal_base.h"
+#include "hal_poll.h"
 
 
 #ifdef __cplusplus
@@ -34,9 +35,13 @@ typedef enum {
 	SOCKET_STATE_CONNECTING,
 	SOCKET_STATE_CONNECTED,
 	SOCKET_STATE_FAILED,
+	SOCKET_STATE_TIMEOUT,
 	SOCKET_STATE_ERROR_UNKNOWN = 99
 } ClientSocketState;
 
+/** Callback for the completion of \ref ClientSocket_connectPoll */
+typedef void (*ClientSocketConnectHandler)(void *user, ClientSocket socket, ClientSocketState state);
+
 /** Opaque reference for a client instance of a server */
 typedef struct sServerClient *ServerClient;
 
@@ -50,12 +55,44 @@ typedef union uClientSocketAddress *ClientSocketAddress;
 
 union uClientSocketAddress {
 	struct {
-		char ip[16];
+		char ip[48];	// IPv4 or IPv6 (INET6_ADDRSTRLEN)
 		uint16_t port;
 	};
 	char address[64];
 };
 
+/** Transport statistics of a TCP connection (see \ref ClientSocket_getStats) */
+typedef struct {
+	uint32_t rttInUs;			//!< smoothed round trip time
+	uint32_t rttVarInUs;		//!< round trip time variation
+	uint32_t minRttInUs;		//!< minimum observed round trip time (0 - not supported by the system)
+	uint32_t mss;				//!< sender maximum segment size
+	uint32_t cwnd;				//!< congestion window in segments
+	uint32_t unacked;			//!< segments in flight
+	uint32_t lost;				//!< segments considered lost now
+	uint32_t retransmits;		//!< total retransmitted segments
+	uint32_t notSentBytes;		//!< bytes in the send buffer not sent yet
+	uint64_t unackedBytes;		//!< bytes sent and not acknowledged yet
+	uint64_t deliveryRate;		//!< recent delivery rate in bytes per second
+	uint64_t bytesSent;			//!< including retransmitted bytes
+	uint64_t bytesAcked;
+	uint64_t bytesReceived;
+} HalTcpStats;
+
+/** Aggregated statistics of the clients of a TCP server (see \ref ServerSocket_getStats) */
+typedef struct {
+	int clients;				//!< number of the connections in the aggregate
+	uint32_t maxRttInUs;
+	uint32_t avgRttInUs;
+	uint64_t retransmits;
+	uint64_t unackedBytes;
+	uint64_t notSentBytes;
+	uint64_t deliveryRate;		//!< sum of the delivery rates
+	uint64_t bytesSent;
+	uint64_t bytesAcked;
+	uint64_t bytesReceived;
+} HalTcpServerStats;
+
 
 /**
  * @defgroup HAL_SOCKET_STREAM_PROT_SPEC Protocol specific API
@@ -67,8 +104,11 @@ union uClientSocketAddress {
 /**
  * \brief Create a new ServerSocket instance
  *
+ * The address family follows the address: NULL - any IPv4 address,
+ * "::" - any IPv6 address (dual-stack: IPv4 clients are accepted too).
+ *
  * \param maxConnections maximum clients for this server
- * \param address ip address or hostname to listen on
+ * \param address ip v4/v6 address or hostname to listen on
  * \param port the TCP port to listen on
  *
  * \return the newly create ServerSocket instance
@@ -76,6 +116,40 @@ union uClientSocketAddress {
 HAL_API ServerSocket
 TcpServerSocket_create(int maxConnections, const char *address, uint16_t port);
 
+/**
+ * \brief Activate TCP Fast Open on the server socket
+ *
+ * Should be called before \ref ServerSocket_listen. The system must allow
+ * server side Fast Open (linux: net.ipv4.tcp_fastopen & 2).
+ *
+ * \param self server socket instance
+ * \param queueLength maximum number of pending Fast Open requests
+ *
+ * \return true in case of success, false otherwise
+ */
+HAL_API bool
+TcpServerSocket_activateFastOpen(ServerSocket self, int queueLength);
+
+/**
+ * \brief Create several ServerSocket instances listening on the same address and port
+ *
+ * Each shard has its own listening socket (SO_REUSEPORT) and its own clients table,
+ * the system balances the incoming connections between the shards. Every shard
+ * can be served by a separate thread or HalPoll.
+ *
+ * Windows: only one shard is supported.
+ *
+ * \param shards storage for the created instances. At least shardsNumber length
+ * \param shardsNumber number of the listeners
+ * \param maxConnections maximum clients for each shard
+ * \param address ip address or hostname to listen on
+ * \param port the TCP port to listen on
+ *
+ * \return true in case of success, false otherwise (no instances are created)
+ */
+HAL_API bool
+TcpServerSocket_createShards(ServerSocket *shards, int shardsNumber, int maxConnections, const char *address, uint16_t port);
+
 /**
  * \brief Create a TCP client socket and bind to system socket
  *
@@ -90,6 +164,8 @@ TcpClientSocket_createAndBind(const char *ip, uint16_t port);
 /**
  * \brief Create a TCP client socket without bind (any address)
  *
+ * The socket is dual-stack (connects to IPv4 and IPv6 servers) if IPv6 is available.
+ *
  * \return a new client socket instance.
  */
 HAL_API ClientSocket
@@ -127,6 +203,131 @@ TcpClientSocket_activateTcpNoDelay(ClientSocket self);
 HAL_API void
 TcpClientSocket_setUnacknowledgedTimeout(ClientSocket self, int timeoutInMs);
 
+/**
+ * \brief Profile of the TCP socket options
+ *
+ * Zero value of a field keeps the system default of the option.
+ */
+typedef struct {
+	int sendBufferSize;			//!< SO_SNDBUF in bytes
+	int receiveBufferSize;		//!< SO_RCVBUF in bytes (window scale is chosen at connect: set it before)
+	bool noDelay;				//!< TCP_NODELAY
+	bool quickAck;				//!< TCP_QUICKACK (linux: the kernel may clear it later)
+	int notSentLowat;			//!< TCP_NOTSENT_LOWAT in bytes: writable only below this amount of unsent data
+	int keepAliveIdle;			//!< keep alive: time (in s) from the last message to the first probe (0 - keep alive is not activated)
+	int keepAliveInterval;		//!< keep alive: time (in s) between probes
+	int keepAliveCount;			//!< keep alive: number of missed probes until the connection is dead
+	int unacknowledgedTimeoutInMs;	//!< TCP_USER_TIMEOUT (see \ref TcpClientSocket_setUnacknowledgedTimeout)
+	int busyPollInUs;			//!< SO_BUSY_POLL: time to busy poll the device queue on blocking reads
+	int priority;				//!< SO_PRIORITY of the outgoing packets (0..6)
+	uint32_t mark;				//!< SO_MARK for the routing and filtering (requires CAP_NET_ADMIN)
+} HalSocketOptions;
+
+/**
+ * \brief Apply the options profile to the TCP client socket
+ *
+ * Call it before \ref ClientSocket_connect to apply the buffer sizes to the connection window.
+ * All options are tried even if one of them fails.
+ *
+ * Windows: busy poll, quick ack, not sent low water mark, priority and mark are ignored.
+ *
+ * \param self client socket instance
+ * \param options the options profile
+ *
+ * \return true if all options are applied, false otherwise
+ */
+HAL_API bool
+TcpClientSocket_applyOptions(ClientSocket self, const HalSocketOptions *options);
+
+/**
+ * \brief Attach the options profile to the TCP server socket
+ *
+ * The profile is copied and applied to every accepted client (\ref ServerSocket_accept)
+ * before the client is returned. The buffer sizes are also set on the listening socket,
+ * so call it before \ref ServerSocket_listen: accepted connections inherit them from the handshake.
+ *
+ * \param self server socket instance
+ * \param options the options profile (NULL - detach the profile)
+ *
+ * \return true in case of success, false otherwise
+ */
+HAL_API bool
+TcpServerSocket_setClientOptions(ServerSocket self, const HalSocketOptions *options);
+
+/** TLS protocol versions for \ref TcpTlsCryptoInfo */
+#define TCP_TLS_VERSION_1_2		0x0303
+#define TCP_TLS_VERSION_1_3		0x0304
+
+/** TLS ciphers for \ref TcpTlsCryptoInfo */
+typedef enum {
+	TCP_TLS_CIPHER_AES_GCM_128,
+	TCP_TLS_CIPHER_AES_GCM_256,
+	TCP_TLS_CIPHER_CHACHA20_POLY1305
+} TcpTlsCipher;
+
+/** TLS record types for \ref TcpClientSocket_writeTlsRecord */
+#define TCP_TLS_RECORD_ALERT			21
+#define TCP_TLS_RECORD_HANDSHAKE		22
+#define TCP_TLS_RECORD_APPLICATION_DATA	23
+
+/** Traffic secrets of one direction negotiated by the TLS handshake */
+typedef struct {
+	uint16_t version;		//!< TCP_TLS_VERSION_1_2 or TCP_TLS_VERSION_1_3
+	TcpTlsCipher cipher;
+	uint8_t key[32];		//!< 16 bytes for AES-GCM-128, 32 bytes otherwise
+	uint8_t iv[12];			//!< 8 bytes for AES-GCM, 12 bytes for ChaCha20-Poly1305
+	uint8_t salt[4];		//!< implicit nonce part (AES-GCM only)
+	uint8_t recSeq[8];		//!< sequence number of the next record (big-endian)
+} TcpTlsCryptoInfo;
+
+/**
+ * \brief Move the record protection of the established TLS session into the kernel (linux kTLS)
+ *
+ * The handshake is done by the application (any TLS library) over the plain socket,
+ * then the negotiated secrets are installed and \ref ClientSocket_write / \ref ClientSocket_read
+ * (and sendfile on the descriptor) transfer the plain text: the kernel encrypts and decrypts the records.
+ * All handshake data must be read before the receive direction is installed.
+ *
+ * A received control record (alert, post-handshake message) makes \ref ClientSocket_read fail:
+ * use \ref TcpClientSocket_readTlsRecord when they are expected.
+ *
+ * The socket can not return to the plain mode: close the connection if the call fails.
+ *
+ * \param self connected TCP client socket instance
+ * \param tx secrets of the transmit direction (NULL - not offloaded)
+ * \param rx secrets of the receive direction (NULL - not offloaded)
+ *
+ * \return true in case of success, false otherwise (errno ENOENT: the kernel has no TLS support)
+ */
+HAL_API bool
+TcpClientSocket_activateTls(ClientSocket self, const TcpTlsCryptoInfo *tx, const TcpTlsCryptoInfo *rx);
+
+/**
+ * \brief Send a TLS record of the given type over the kTLS socket (e.g. close_notify alert)
+ *
+ * \param self the client socket instance with the offloaded transmit direction
+ * \param recordType type of the record (TCP_TLS_RECORD_*)
+ * \param buf record content
+ * \param size size of the content
+ *
+ * \return number of bytes transmitted, 0 if the socket buffer is full or -1 in case of an error
+ */
+HAL_API int
+TcpClientSocket_writeTlsRecord(ClientSocket self, uint8_t recordType, const uint8_t *buf, int size);
+
+/**
+ * \brief Read the content of the next TLS record of any type from the kTLS socket (non-blocking)
+ *
+ * \param self the client socket instance with the offloaded receive direction
+ * \param recordType type of the received record (TCP_TLS_RECORD_*)
+ * \param buf the buffer where the record content is copied to
+ * \param size the size of the provided buffer
+ *
+ * \return number of bytes read, 0 if no data is available or -1 in case of an error
+ */
+HAL_API int
+TcpClientSocket_readTlsRecord(ClientSocket self, uint8_t *recordType, uint8_t *buf, int size);
+
 
 /**
  * \brief Create a new ServerSocket instance
@@ -155,6 +356,19 @@ LocalServerSocket_unlinkAddress(const char *address);
 HAL_API ClientSocket
 LocalClientSocket_create(void);
 
+/**
+ * \brief Create a client socket from the connected stream socket descriptor
+ *
+ * Used to take over the connection received by \ref ClientSocket_recvDescriptors.
+ * The instance owns the descriptor afterwards.
+ *
+ * \param ud the connected socket descriptor (AF_INET or AF_UNIX)
+ *
+ * \return a new client socket instance or NULL if the descriptor is not a stream socket
+ */
+HAL_API ClientSocket
+ClientSocket_createFromDescriptor(unidesc ud);
+
 
 /*! @} */
 
@@ -193,6 +407,9 @@ ServerSocket_getClientsNumber(ServerSocket self);
 /**
  * \brief Get the list of the server active clients
  *
+ * The list is maintained on accept/destroy and is ordered by accept time.
+ * It must not be walked while clients are destroyed from another thread.
+ *
  * \param self server socket instance
  *
  * \return head of the clients list
@@ -200,6 +417,19 @@ ServerSocket_getClientsNumber(ServerSocket self);
 HAL_API ServerClient
 ServerSocket_getClients(ServerSocket self);
 
+/**
+ * \brief Aggregate the transport statistics of the connected clients of the TCP server
+ *
+ * Only the active clients are walked (one TCP_INFO request per client).
+ *
+ * \param self the TCP server socket instance
+ * \param stats the aggregated statistics
+ *
+ * \return true in case of success, false otherwise
+ */
+HAL_API bool
+ServerSocket_getStats(ServerSocket self, HalTcpServerStats *stats);
+
 /**
  * \brief Close all static clients soket related this server
  *
@@ -247,7 +477,10 @@ ClientSocket_connect(ClientSocket self, const ClientSocketAddress address, uint3
 /**
  * \brief Connect to a server
  *
- * Connect to a server application identified by the address
+ * Connect to a server application identified by the address.
+ * A host name is resolved synchronously unless the resolver is installed for the
+ * sockets (\ref HalResolver_setSocketResolver): then the call fails at once with errno
+ * EWOULDBLOCK while the name is being resolved.
  *
  * \param self the client socket instance
  * \param address remote server address (protocol specific)
@@ -257,6 +490,49 @@ ClientSocket_connect(ClientSocket self, const ClientSocketAddress address, uint3
 HAL_API bool
 ClientSocket_connectAsync(ClientSocket self, const ClientSocketAddress address);
 
+/**
+ * \brief Connect to a server and send the first data (TCP Fast Open)
+ *
+ * The data is sent with the SYN segment if the Fast Open cookie of the server is known.
+ * Otherwise the function falls back to the ordinary connect (\ref ClientSocket_connectAsync)
+ * and the rest of the data (size - return value) must be written after the connection
+ * is established.
+ *
+ * \param self the client socket instance (TCP only)
+ * \param address remote server address
+ * \param buf data to send
+ * \param size size of data
+ *
+ * \return number of bytes sent with the connection request (may be 0) or -1 in case of an error
+ */
+HAL_API int
+ClientSocket_connectWithData(ClientSocket self, const ClientSocketAddress address, const uint8_t *buf, int size);
+
+/**
+ * \brief Connect to a server without blocking using HalPoll
+ *
+ * The socket is registered in the poll for the HAL_POLLOUT event. If timeoutInMs is
+ * not zero the deadline is served by one timer shared by all pending connects of the poll.
+ * On completion the socket is removed from the poll (and the timer after the last pending
+ * deadline) and the handler is called with one of the states:
+ * SOCKET_STATE_CONNECTED, SOCKET_STATE_FAILED or SOCKET_STATE_TIMEOUT.
+ * The socket should be reset (\ref ClientSocket_reset) before the next attempt in
+ * case of failure or timeout. \ref ClientSocket_destroy cancels the pending connect
+ * without calling the handler.
+ *
+ * \param self the client socket instance
+ * \param address remote server address (protocol specific)
+ * \param poll a HalPoll instance serving the socket
+ * \param timeoutInMs the timeout in ms (0 - no timeout)
+ * \param user user data passed to the handler
+ * \param handler completion callback
+ *
+ * \return true if the connection is in progress, false otherwise (the handler will not be called)
+ */
+HAL_API bool
+ClientSocket_connectPoll(ClientSocket self, const ClientSocketAddress address, HalPoll poll,
+		uint32_t timeoutInMs, void *user, ClientSocketConnectHandler handler);
+
 /**
  * \brief Reset system socket (close and open)
  *
@@ -292,6 +568,25 @@ ClientSocket_checkConnectState(ClientSocket self);
 HAL_API int
 ClientSocket_read(ClientSocket self, uint8_t *buf, int size);
 
+/**
+ * \brief Read from socket to local buffer and report pending data (non-blocking)
+ *
+ * Unlike \ref ClientSocket_read the end of the stream is reported as an error.
+ * No \ref ClientSocket_readAvailable call is needed to size the buffer: if the
+ * buffer was filled completely more data is probably pending and the function
+ * should be called again, otherwise the socket is drained.
+ *
+ * \param self the client socket instance
+ * \param buf the buffer where the read bytes are copied to
+ * \param size the maximum number of bytes to read (size of the provided buffer)
+ * \param more storage for the pending flag (may be NULL)
+ *
+ * \return the number of bytes read, 0 if no data is available or -1 if an error occurred
+ *  or the peer closed the connection
+ */
+HAL_API int
+ClientSocket_receive(ClientSocket self, uint8_t *buf, int size, bool *more);
+
 /**
  * \brief Send a message through the socket
  *
@@ -304,6 +599,44 @@ ClientSocket_read(ClientSocket self, uint8_t *buf, int size);
 HAL_API int
 ClientSocket_write(ClientSocket self, const uint8_t *buf, int size);
 
+/**
+ * \brief Maximum number of the descriptors passed by one call
+ */
+#define CLIENT_SOCKET_MAX_DESCRIPTORS 16
+
+/**
+ * \brief Pass the descriptors to the peer process with a message (local sockets only, SCM_RIGHTS)
+ *
+ * The peer gets its own duplicates of the descriptors: sockets, memfds, timerfds, etc.
+ * The caller may close the descriptors after the call.
+ *
+ * \param self the local client socket instance
+ * \param descs the descriptors to pass
+ * \param count number of the descriptors (1..CLIENT_SOCKET_MAX_DESCRIPTORS)
+ * \param buf data to send with the descriptors (may be NULL: one zero byte is sent then)
+ * \param size size of data
+ *
+ * \return number of bytes transmitted, 0 if the socket buffer is full or -1 in case of an error
+ */
+HAL_API int
+ClientSocket_sendDescriptors(ClientSocket self, const unidesc *descs, int count, const uint8_t *buf, int size);
+
+/**
+ * \brief Receive the descriptors passed by \ref ClientSocket_sendDescriptors (non-blocking)
+ *
+ * The received descriptors are owned by the caller. Descriptors over the buffer are closed.
+ *
+ * \param self the local client socket instance
+ * \param descs the buffer for the descriptors
+ * \param count in: size of the descriptors buffer; out: number of received descriptors
+ * \param buf the buffer for the data sent with the descriptors (may be NULL: one byte is read then)
+ * \param size size of the data buffer
+ *
+ * \return number of bytes read, 0 if no data is available or -1 in case of an error
+ */
+HAL_API int
+ClientSocket_recvDescriptors(ClientSocket self, unidesc *descs, int *count, uint8_t *buf, int size);
+
 /**
  * \brief Get the address of the peer application (IP address and port number)
  *
@@ -318,6 +651,10 @@ ClientUnidesc_getPeerAddress(unidesc ud, ClientSocketAddress address);
 /**
  * \brief Get the address of the peer application (IP address and port number)
  *
+ * The address is captured at accept time and returned without system calls.
+ * For an outgoing connection it is captured at the first call after the connection
+ * is established; while the connection is in progress or after it failed the call fails.
+ *
  * \param self the client socket instance
  * \param address remote server address (protocol specific)
  *
@@ -329,6 +666,8 @@ ClientSocket_getPeerAddress(ClientSocket self, ClientSocketAddress address);
 /**
  * \brief Get the address of the this application (IP address and port number)
  *
+ * The address is requested once per connection and cached.
+ *
  * \param self the client socket instance
  * \param address local address (protocol specific)
  *
@@ -337,6 +676,19 @@ ClientSocket_getPeerAddress(ClientSocket self, ClientSocketAddress address);
 HAL_API bool
 ClientSocket_getLocalAddress(ClientSocket self, ClientSocketAddress address);
 
+/**
+ * \brief Get the transport statistics of the TCP connection (linux: TCP_INFO)
+ *
+ * One system call without allocations: it may be called periodically for every connection.
+ *
+ * \param self the TCP client socket instance
+ * \param stats the statistics
+ *
+ * \return true in case of success, false otherwise
+ */
+HAL_API bool
+ClientSocket_getStats(ClientSocket self, HalTcpStats *stats);
+
 /**
  * \brief Get the number of bytes available for reading from the socket
  *
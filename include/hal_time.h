@@ -55,6 +55,14 @@ Hal_getTimeInMs(void);
 HAL_API uint64_t
 Hal_getMonotonicTimeInMs(void);
 
+/**
+ * Get the system monotonic time in nanoseconds.
+ *
+ * \return the system time with nanosecond resolution (the actual resolution depends on the system).
+ */
+HAL_API uint64_t
+Hal_getMonotonicTimeInNs(void);
+
 /**
  * Set the system real time
  *
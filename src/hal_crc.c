@@ -0,0 +1,286 @@
+#include "hal_crc.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+# include <windows.h>
+#else
+# include <pthread.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# include <cpuid.h>
+# define CRC_X86
+# define CRC_TARGET __attribute__((target("sse4.2,pclmul")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+# include <intrin.h>
+# define CRC_X86
+# define CRC_TARGET
+#endif
+
+#ifdef CRC_X86
+# include <nmmintrin.h>
+# include <wmmintrin.h>
+#endif
+
+#if defined(__GNUC__)
+# define CRC_LOAD(v) __atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+# define CRC_STORE(v, x) __atomic_store_n(&(v), (x), __ATOMIC_RELEASE)
+#else
+// msvc: volatile accesses are atomic with acquire/release semantics on x86/x64 (/volatile:ms)
+# define CRC_LOAD(v) (*(volatile int *)&(v))
+# define CRC_STORE(v, x) (*(volatile int *)&(v) = (x))
+#endif
+
+
+typedef enum {
+	CRC16,
+	CRC32,
+	CRC32C,
+	CRC_COUNT
+} CrcKind;
+
+/* reflected polynomials */
+static const uint32_t crcPolys[CRC_COUNT] = { 0xA001, 0xEDB88320, 0x82F63B78 };
+
+/* [k][b]: contribution of the byte b followed by k zero bytes */
+static uint32_t crcTables[CRC_COUNT][8][256];
+
+/* written once by crcBuild, published by the once-flag */
+static int crcHasSse42 = 0;
+static int crcHasPclmul = 0;
+
+static int crcHardware = 1;		// CRC_LOAD/CRC_STORE: changed by HalCrc_setHardware at any time
+
+#if defined(_WIN32) || defined(_WIN64)
+static INIT_ONCE crcOnce = INIT_ONCE_STATIC_INIT;
+#else
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+#endif
+
+
+static void crcBuild(void)
+{
+	for (int k = 0; k < CRC_COUNT; ++k) {
+		for (uint32_t b = 0; b < 256; ++b) {
+			uint32_t c = b;
+			for (int i = 0; i < 8; ++i) {
+				c = (c & 1)? (c >> 1) ^ crcPolys[k] : (c >> 1);
+			}
+			crcTables[k][0][b] = c;
+		}
+		for (uint32_t b = 0; b < 256; ++b) {
+			for (int t = 1; t < 8; ++t) {
+				uint32_t c = crcTables[k][t-1][b];
+				crcTables[k][t][b] = (c >> 8) ^ crcTables[k][0][c & 0xFF];
+			}
+		}
+	}
+#ifdef CRC_X86
+	unsigned int regs[4] = { 0, 0, 0, 0 };
+# if defined(_MSC_VER)
+	__cpuid((int *)regs, 1);
+# else
+	__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+# endif
+	crcHasSse42 = (regs[2] >> 20) & 1;
+	crcHasPclmul = ((regs[2] >> 1) & 1) && ((regs[2] >> 19) & 1); // pclmul and sse4.1 (extract)
+#endif
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static BOOL CALLBACK crcBuildOnce(PINIT_ONCE once, PVOID param, PVOID *context)
+{
+	(void)once; (void)param; (void)context;
+	crcBuild();
+	return TRUE;
+}
+#endif
+
+static void crcInit(void)
+{
+#if defined(_WIN32) || defined(_WIN64)
+	InitOnceExecuteOnce(&crcOnce, crcBuildOnce, NULL, NULL);
+#else
+	pthread_once(&crcOnce, crcBuild);
+#endif
+}
+
+static inline uint32_t load32le(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* slicing-by-8 for any reflected crc up to 32 bits: the register is zero-extended */
+static uint32_t crcSlice8(const uint32_t t[8][256], uint32_t crc, const uint8_t *p, size_t size)
+{
+	while (size >= 8) {
+		uint32_t lo = crc ^ load32le(p);
+		uint32_t hi = load32le(p + 4);
+		crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+				t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+		p += 8;
+		size -= 8;
+	}
+	while (size--) {
+		crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+	}
+	return crc;
+}
+
+#ifdef CRC_X86
+CRC_TARGET
+static uint32_t crc32cSse42(uint32_t crc, const uint8_t *p, size_t size)
+{
+	while (size > 0 && ((uintptr_t)p & 7)) {
+		crc = _mm_crc32_u8(crc, *p++);
+		size--;
+	}
+# if defined(__x86_64__) || defined(_M_X64)
+	uint64_t crc64 = crc;
+	while (size >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		crc64 = _mm_crc32_u64(crc64, v);
+		p += 8;
+		size -= 8;
+	}
+	crc = (uint32_t)crc64;
+# endif
+	while (size >= 4) {
+		uint32_t v;
+		memcpy(&v, p, 4);
+		crc = _mm_crc32_u32(crc, v);
+		p += 4;
+		size -= 4;
+	}
+	while (size--) {
+		crc = _mm_crc32_u8(crc, *p++);
+	}
+	return crc;
+}
+
+/*
+ * Folding by the carry-less multiplication with the Barrett reduction
+ * ("Fast CRC Computation for Generic Polynomials Using PCLMULQDQ", Intel).
+ * size is a multiple of 16, at least 64.
+ */
+CRC_TARGET
+static uint32_t crc32Pclmul(uint32_t crc, const uint8_t *p, size_t size)
+{
+	// the bit-reflected constants of the polynomial 0x04C11DB7
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+	const __m128i k5k0 = _mm_set_epi64x(0x0000000000LL, 0x0163cd6124LL);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	p += 64;
+	size -= 64;
+
+	// four lanes of 16 bytes
+	while (size >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(p + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(p + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(p + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(p + 0x30)));
+		p += 64;
+		size -= 64;
+	}
+
+	// the lanes into one
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	while (size >= 16) {
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)p)), x5);
+		p += 16;
+		size -= 16;
+	}
+
+	// 128 to 64 bits
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits
+	x2 = _mm_and_si128(x1, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+#endif
+
+
+uint16_t HalCrc_crc16(uint16_t crc, const void *data, size_t size)
+{
+	if (data == NULL) return crc;
+	crcInit();
+	// the frames are short: the folding does not pay off
+	return (uint16_t)crcSlice8(crcTables[CRC16], crc, (const uint8_t *)data, size);
+}
+
+uint32_t HalCrc_crc32(uint32_t crc, const void *data, size_t size)
+{
+	if (data == NULL) return crc;
+	const uint8_t *p = (const uint8_t *)data;
+	crcInit();
+	crc = ~crc;
+#ifdef CRC_X86
+	if (size >= 64 && crcHasPclmul && CRC_LOAD(crcHardware)) {
+		size_t n = size & ~(size_t)15;
+		crc = crc32Pclmul(crc, p, n);
+		p += n;
+		size -= n;
+	}
+#endif
+	crc = crcSlice8(crcTables[CRC32], crc, p, size);
+	return ~crc;
+}
+
+uint32_t HalCrc_crc32c(uint32_t crc, const void *data, size_t size)
+{
+	if (data == NULL) return crc;
+	crcInit();
+	crc = ~crc;
+#ifdef CRC_X86
+	if (crcHasSse42 && CRC_LOAD(crcHardware)) {
+		return ~crc32cSse42(crc, (const uint8_t *)data, size);
+	}
+#endif
+	crc = crcSlice8(crcTables[CRC32C], crc, (const uint8_t *)data, size);
+	return ~crc;
+}
+
+bool HalCrc_setHardware(bool enable)
+{
+	crcInit();
+	CRC_STORE(crcHardware, (enable)? 1 : 0);
+	return enable && (crcHasSse42 || crcHasPclmul);
+}
@@ -0,0 +1,121 @@
+#include "hal_poll_deadline.h"
+#include "hal_time.h"
+#include "hal_timer.h"
+
+
+struct sPollDeadlines {
+	HalPoll poll;
+	Timer timer;
+	PollDeadline *head;		// sorted by the expiration time
+	bool dispatching;
+};
+
+
+/* the timer is removed from the poll while no deadline is pending */
+static void armTimer(PollDeadlines self)
+{
+	if (self->head == NULL) {
+		if (!self->dispatching) {
+			*HalPoll_getDeadlines(self->poll) = NULL;
+			PollDeadlines_destroy(self);
+		}
+		return;
+	}
+	uint64_t now = Hal_getMonotonicTimeInNs();
+	uint64_t ns = (self->head->expires > now)? self->head->expires - now : 1; // 0 disarms
+	AccurateTime_t timeout;
+	timeout.sec = (uint32_t)(ns / 1000000000ULL);
+	timeout.nsec = (uint32_t)(ns % 1000000000ULL);
+	Timer_setTimeout(self->timer, &timeout);
+}
+
+static void onDeadlineTimer(void *user, void *object, int revents)
+{
+	PollDeadlines self = (PollDeadlines)object;
+	(void)user;
+	(void)revents;
+	Timer_endEvent(self->timer);
+	uint64_t now = Hal_getMonotonicTimeInNs();
+	// the handlers may start and cancel the deadlines
+	self->dispatching = true;
+	while (self->head && self->head->expires <= now) {
+		PollDeadline *d = self->head;
+		self->head = d->next;
+		d->next = NULL;
+		d->poll = NULL;
+		d->handler(d->object);
+	}
+	self->dispatching = false;
+	armTimer(self);
+}
+
+bool PollDeadline_start(PollDeadline *self, HalPoll poll, uint32_t timeoutInMs, void *object, PollDeadlineHandler handler)
+{
+	if (self == NULL || poll == NULL || handler == NULL) return false;
+	PollDeadlines *slot = HalPoll_getDeadlines(poll);
+	if (slot == NULL) return false;
+	PollDeadline_cancel(self);
+
+	PollDeadlines list = *slot;
+	if (list == NULL) {
+		list = (PollDeadlines)calloc(1, sizeof(struct sPollDeadlines));
+		if (list == NULL) return false;
+		list->poll = poll;
+		list->timer = Timer_create();
+		if (list->timer == NULL) goto exit_error;
+		if (!HalPoll_update(poll, Timer_getDescriptor(list->timer), HAL_POLLIN, list, NULL, onDeadlineTimer)) {
+			goto exit_error;
+		}
+		*slot = list;
+	}
+
+	self->poll = poll;
+	self->expires = Hal_getMonotonicTimeInNs() + (uint64_t)timeoutInMs * 1000000ULL;
+	self->object = object;
+	self->handler = handler;
+	PollDeadline **pp = &(list->head);
+	while (*pp && (*pp)->expires <= self->expires) {
+		pp = &((*pp)->next);
+	}
+	self->next = *pp;
+	*pp = self;
+	if (list->head == self) {
+		armTimer(list);
+	}
+	return true;
+
+exit_error:
+	Timer_destroy(list->timer);
+	free(list);
+	return false;
+}
+
+void PollDeadline_cancel(PollDeadline *self)
+{
+	if (self == NULL || self->poll == NULL) return;
+	PollDeadlines list = *HalPoll_getDeadlines(self->poll);
+	self->poll = NULL;
+	if (list == NULL) return;
+	bool first = (list->head == self);
+	PollDeadline **pp = &(list->head);
+	while (*pp && *pp != self) {
+		pp = &((*pp)->next);
+	}
+	if (*pp) *pp = self->next;
+	self->next = NULL;
+	if (first) {
+		armTimer(list);
+	}
+}
+
+void PollDeadlines_destroy(PollDeadlines self)
+{
+	if (self == NULL) return;
+	// the pending deadlines are not scheduled any more
+	for (PollDeadline *d = self->head; d; d = d->next) {
+		d->poll = NULL;
+	}
+	HalPoll_remove(self->poll, Timer_getDescriptor(self->timer));
+	Timer_destroy(self->timer);
+	free(self);
+}
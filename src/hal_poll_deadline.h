@@ -0,0 +1,32 @@
+#ifndef HAL_POLL_DEADLINE_H
+#define HAL_POLL_DEADLINE_H
+
+#include "hal_base.h"
+#include "hal_poll.h"
+
+/*
+ * Deadlines served by one timer per HalPoll: the pending operations of the poll
+ * thread (e.g. ClientSocket_connectPoll) do not need a timer descriptor each.
+ * All calls are done in the thread of the poll.
+ */
+
+typedef void (*PollDeadlineHandler)(void *object);
+
+typedef struct sPollDeadline {
+	HalPoll poll;				// NULL - not scheduled
+	uint64_t expires;			// monotonic time, ns
+	void *object;
+	PollDeadlineHandler handler;
+	struct sPollDeadline *next;
+} PollDeadline;
+
+typedef struct sPollDeadlines *PollDeadlines;
+
+HAL_INTERNAL bool PollDeadline_start(PollDeadline *self, HalPoll poll, uint32_t timeoutInMs, void *object, PollDeadlineHandler handler);
+HAL_INTERNAL void PollDeadline_cancel(PollDeadline *self);
+HAL_INTERNAL void PollDeadlines_destroy(PollDeadlines self);
+
+// implemented by HalPoll: the list of the poll (created at the first deadline)
+HAL_INTERNAL PollDeadlines *HalPoll_getDeadlines(HalPoll self);
+
+#endif /* HAL_POLL_DEADLINE_H */
@@ -2,6 +2,7 @@
 #ifdef __linux__
 
 #include "hal_poll.h"
+#include "hal_poll_deadline.h"
 #include <sys/poll.h>
 #include <errno.h>
 
@@ -65,6 +66,7 @@ struct sHalPoll {
 	void *user;
 	bool updated;
 	bool autoRealloc;
+	PollDeadlines deadlines;	// shared timer of the pending operations
 };
 
 
@@ -347,6 +349,8 @@ bool HalPoll_updatePriority(HalPoll self, unidesc fd, int p)
 void HalPoll_clear(HalPoll self)
 {
 	if (self == NULL) return;
+	PollDeadlines_destroy(self->deadlines); // its timer is registered in the poll
+	self->deadlines = NULL;
 	for (int i = 0; i < self->size; ++i) {
 		setSysPollfd(self, i, Hal_getInvalidUnidesc().i32, 0, 0);
 		self->objects[i].object = NULL;
@@ -416,9 +420,16 @@ void HalPoll_setAutoRealloc(HalPoll self, bool enable)
 }
 
 
+PollDeadlines *HalPoll_getDeadlines(HalPoll self)
+{
+	if (self == NULL) return NULL;
+	return &(self->deadlines);
+}
+
 void HalPoll_destroy(HalPoll self)
 {
 	if (self == NULL) return;
+	PollDeadlines_destroy(self->deadlines);
 	free(self->pfd);
 	free(self->objects);
 	free(self);
@@ -2,6 +2,7 @@
 #if defined(_WIN32) || defined(_WIN64)
 
 #include "hal_poll.h"
+#include "hal_poll_deadline.h"
 #include <winsock2.h>
 
 
@@ -118,6 +119,7 @@ struct sHalPoll {
 	int size;
 	void *user;
 	bool updated;
+	PollDeadlines deadlines;	// shared timer of the pending operations
 };
 
 
@@ -349,6 +351,8 @@ bool HalPoll_remove(HalPoll self, unidesc fd)
 void HalPoll_clear(HalPoll self)
 {
 	if (self == NULL) return;
+	PollDeadlines_destroy(self->deadlines); // its timer is registered in the poll
+	self->deadlines = NULL;
 	for (int i = 0; i < self->size; ++i) {
 		setSysPollfd(self, i, Hal_getInvalidUnidesc().u64, 0, 0, false);
 		self->objects[i].object = NULL;
@@ -393,8 +397,15 @@ int HalPoll_wait(HalPoll self, int timeout)
 }
 
 
+PollDeadlines *HalPoll_getDeadlines(HalPoll self)
+{
+	if (self == NULL) return NULL;
+	return &(self->deadlines);
+}
+
 void HalPoll_destroy(HalPoll self)
 {
+	PollDeadlines_destroy(self->deadlines);
 	free(self->pfd);
 	free(self->objects);
 	free(self);
@@ -0,0 +1,345 @@
+#ifdef __linux__
+# include <arpa/inet.h>
+# include <netdb.h>
+# include <sys/socket.h>
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+# include <winsock2.h>
+# include <ws2tcpip.h>
+#endif
+
+#include "hal_resolver.h"
+#include "hal_thread.h"
+#include "hal_time.h"
+
+
+#define RESOLVER_HOST_SIZE 256
+
+typedef enum {
+	ENTRY_FREE,
+	ENTRY_QUEUED,
+	ENTRY_RESOLVING,
+	ENTRY_READY,
+	ENTRY_FAILED
+} EntryState;
+
+typedef struct {
+	bool hasV4;
+	bool hasV6;
+	bool v6First;		// the first result of getaddrinfo is IPv6
+	struct sockaddr_in v4;
+	struct sockaddr_in6 v6;	// with the scope id
+} ResolvedAddress;
+
+typedef struct {
+	EntryState state;
+	bool hasAddress;	// the address is valid (may be expired)
+	uint64_t expires;
+	uint64_t used;		// last lookup time (eviction)
+	char host[RESOLVER_HOST_SIZE];
+	ResolvedAddress address;
+} ResolverEntry;
+
+struct sHalResolver {
+	Mutex mu;
+	Thread thread;
+	Signal request;		// to the thread: new names are queued
+	Signal done;		// to the user: resolution is finished
+	bool stop;
+	uint32_t ttl;
+	int size;
+	ResolverEntry *entries;
+};
+
+static HalResolver volatile socketResolver = NULL;	// see HalResolver_setSocketResolver
+
+
+static bool isNumericAddress(const char *host)
+{
+	uint8_t buf[16];
+	return (inet_pton(AF_INET, host, buf) == 1 || inet_pton(AF_INET6, host, buf) == 1);
+}
+
+static bool resolveHost(const char *host, ResolvedAddress *address)
+{
+	struct addrinfo hints;
+	struct addrinfo *result;
+
+	memset(address, 0, sizeof(ResolvedAddress));
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, NULL, &hints, &result) != 0) {
+		return false;
+	}
+	// the first address of each family, as the sockets take them from getaddrinfo
+	for (struct addrinfo *ai = result; ai; ai = ai->ai_next) {
+		if (ai->ai_family == AF_INET && !address->hasV4) {
+			memcpy(&(address->v4), ai->ai_addr, sizeof(struct sockaddr_in));
+			address->hasV4 = true;
+		}
+		else if (ai->ai_family == AF_INET6 && !address->hasV6) {
+			memcpy(&(address->v6), ai->ai_addr, sizeof(struct sockaddr_in6));
+			address->hasV6 = true;
+			address->v6First = !address->hasV4;
+		}
+	}
+	freeaddrinfo(result);
+	return (address->hasV4 || address->hasV6);
+}
+
+static ResolverEntry *findEntry(HalResolver self, const char *host)
+{
+	for (int i = 0; i < self->size; ++i) {
+		ResolverEntry *e = &(self->entries[i]);
+		if (e->state != ENTRY_FREE && strcmp(e->host, host) == 0) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+static ResolverEntry *allocEntry(HalResolver self)
+{
+	ResolverEntry *victim = NULL;
+	for (int i = 0; i < self->size; ++i) {
+		ResolverEntry *e = &(self->entries[i]);
+		if (e->state == ENTRY_FREE) {
+			return e;
+		}
+		if (e->state == ENTRY_READY || e->state == ENTRY_FAILED) {
+			if (victim == NULL || e->used < victim->used) {
+				victim = e;
+			}
+		}
+	}
+	return victim; // least recently used
+}
+
+static void *resolverThread(void *parameter)
+{
+	HalResolver self = (HalResolver)parameter;
+	char host[RESOLVER_HOST_SIZE];
+	ResolvedAddress address;
+
+	while (1) {
+		HalSignal_wait(self->request);
+		while (1) {
+			ResolverEntry *e = NULL;
+			HalMutex_lock(self->mu);
+			if (self->stop) {
+				HalMutex_unlock(self->mu);
+				return NULL;
+			}
+			for (int i = 0; i < self->size; ++i) {
+				if (self->entries[i].state == ENTRY_QUEUED) {
+					e = &(self->entries[i]);
+					break;
+				}
+			}
+			if (e) {
+				e->state = ENTRY_RESOLVING;
+				strcpy(host, e->host);
+			}
+			HalMutex_unlock(self->mu);
+			if (e == NULL) break;
+
+			bool ok = resolveHost(host, &address);
+
+			HalMutex_lock(self->mu);
+			// the entry may be flushed meanwhile
+			if (e->state == ENTRY_RESOLVING && strcmp(e->host, host) == 0) {
+				if (ok) {
+					e->address = address;
+					e->hasAddress = true;
+					e->expires = Hal_getMonotonicTimeInMs() + self->ttl;
+					e->state = ENTRY_READY;
+				} else {
+					e->hasAddress = false;
+					e->state = ENTRY_FAILED;
+				}
+			}
+			HalMutex_unlock(self->mu);
+			HalSignal_raise(self->done);
+		}
+	}
+	return NULL;
+}
+
+
+HalResolver HalResolver_create(int maxEntries, uint32_t ttlInMs)
+{
+	if (maxEntries <= 0) return NULL;
+	HalResolver self = (HalResolver)calloc(1, sizeof(struct sHalResolver));
+	if (self == NULL) return NULL;
+
+	self->ttl = ttlInMs;
+	self->size = maxEntries;
+	self->entries = (ResolverEntry *)calloc(maxEntries, sizeof(ResolverEntry));
+	if (self->entries == NULL) goto exit_error;
+	self->mu = HalMutex_create();
+	if (self->mu == NULL) goto exit_error;
+	self->request = HalSignal_create();
+	if (self->request == NULL) goto exit_error;
+	self->done = HalSignal_create();
+	if (self->done == NULL) goto exit_error;
+	self->thread = HalThread_create(0, resolverThread, self, false);
+	if (self->thread == NULL) goto exit_error;
+	HalThread_setName(self->thread, "halresolver");
+	HalThread_start(self->thread);
+	return self;
+
+exit_error:
+	HalSignal_destroy(self->done);
+	HalSignal_destroy(self->request);
+	HalMutex_destroy(self->mu);
+	free(self->entries);
+	free(self);
+	return NULL;
+}
+
+/*
+ * Takes the cached address of the host or queues the host for the resolution.
+ * Numeric addresses are not handled here.
+ */
+static HalResolveState lookupEntry(HalResolver self, const char *host, ResolvedAddress *address)
+{
+	HalResolveState ret = HAL_RESOLVE_PENDING;
+	bool queued = false;
+	uint64_t now = Hal_getMonotonicTimeInMs();
+
+	if (strlen(host) >= RESOLVER_HOST_SIZE) return HAL_RESOLVE_FAILED;
+
+	HalMutex_lock(self->mu);
+	ResolverEntry *e = findEntry(self, host);
+	if (e) {
+		e->used = now;
+		switch (e->state) {
+			case ENTRY_READY:
+				if (now >= e->expires) { // refresh, the expired address is still used
+					e->state = ENTRY_QUEUED;
+					queued = true;
+				}
+				break;
+			case ENTRY_FAILED:
+				e->state = ENTRY_FREE;
+				ret = HAL_RESOLVE_FAILED;
+				break;
+			default: break;
+		}
+		if (e->hasAddress && ret != HAL_RESOLVE_FAILED) {
+			*address = e->address;
+			ret = HAL_RESOLVE_DONE;
+		}
+	} else {
+		e = allocEntry(self);
+		if (e) {
+			memset(e, 0, sizeof(ResolverEntry));
+			strcpy(e->host, host);
+			e->used = now;
+			e->state = ENTRY_QUEUED;
+			queued = true;
+		} else {
+			ret = HAL_RESOLVE_FAILED;
+		}
+	}
+	HalMutex_unlock(self->mu);
+
+	if (queued) {
+		HalSignal_raise(self->request);
+	}
+	return ret;
+}
+
+HalResolveState HalResolver_lookup(HalResolver self, const char *host, char *address)
+{
+	if (self == NULL || host == NULL || address == NULL) return HAL_RESOLVE_FAILED;
+
+	if (isNumericAddress(host)) {
+		strncpy(address, host, HAL_RESOLVER_ADDRESS_SIZE-1);
+		address[HAL_RESOLVER_ADDRESS_SIZE-1] = '\0';
+		return HAL_RESOLVE_DONE;
+	}
+
+	ResolvedAddress resolved;
+	HalResolveState ret = lookupEntry(self, host, &resolved);
+	if (ret == HAL_RESOLVE_DONE) {
+		const char *ok = (resolved.v6First)?
+			inet_ntop(AF_INET6, &(resolved.v6.sin6_addr), address, HAL_RESOLVER_ADDRESS_SIZE) :
+			inet_ntop(AF_INET, &(resolved.v4.sin_addr), address, HAL_RESOLVER_ADDRESS_SIZE);
+		if (ok == NULL) ret = HAL_RESOLVE_FAILED;
+	}
+	return ret;
+}
+
+/*
+ * For the socket functions: the address is selected as by their getaddrinfo call
+ * (AF_INET - IPv4 only, otherwise the first result). The IPv6 address keeps the scope id.
+ */
+HAL_INTERNAL HalResolveState HalResolver_lookupAddress(HalResolver self, const char *host, int family, struct sockaddr_storage *sockaddr)
+{
+	ResolvedAddress resolved;
+	HalResolveState ret = lookupEntry(self, host, &resolved);
+	if (ret != HAL_RESOLVE_DONE) return ret;
+
+	if (resolved.hasV4 && (family == AF_INET || !resolved.v6First)) {
+		memcpy(sockaddr, &(resolved.v4), sizeof(struct sockaddr_in));
+		return HAL_RESOLVE_DONE;
+	}
+	if (resolved.hasV6 && family != AF_INET) {
+		memcpy(sockaddr, &(resolved.v6), sizeof(struct sockaddr_in6));
+		return HAL_RESOLVE_DONE;
+	}
+	return HAL_RESOLVE_FAILED; // no address of the family
+}
+
+unidesc HalResolver_getDescriptor(HalResolver self)
+{
+	if (self == NULL) return Hal_getInvalidUnidesc();
+	return HalSignal_getDescriptor(self->done);
+}
+
+void HalResolver_endEvent(HalResolver self)
+{
+	if (self == NULL) return;
+	HalSignal_end(self->done);
+}
+
+void HalResolver_flush(HalResolver self)
+{
+	if (self == NULL) return;
+	HalMutex_lock(self->mu);
+	for (int i = 0; i < self->size; ++i) {
+		self->entries[i].state = ENTRY_FREE;
+	}
+	HalMutex_unlock(self->mu);
+}
+
+void HalResolver_setSocketResolver(HalResolver self)
+{
+	socketResolver = self;
+}
+
+HAL_INTERNAL HalResolver HalResolver_getSocketResolver(void)
+{
+	return socketResolver;
+}
+
+void HalResolver_destroy(HalResolver self)
+{
+	if (self == NULL) return;
+	if (socketResolver == self) {
+		socketResolver = NULL;
+	}
+	HalMutex_lock(self->mu);
+	self->stop = true;
+	HalMutex_unlock(self->mu);
+	HalSignal_raise(self->request);
+	HalThread_destroy(self->thread); // joins
+	HalSignal_destroy(self->done);
+	HalSignal_destroy(self->request);
+	HalMutex_destroy(self->mu);
+	free(self->entries);
+	free(self);
+}
@@ -1,22 +1,118 @@
 
 #ifdef __linux__
 
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <termios.h>
 #include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <sched.h>
 #include <time.h>
+#include <linux/serial.h>
+#include <sys/ioctl.h>
 #include <sys/select.h>
 #include <unistd.h>
 
 #include "hal_serial.h"
+#include "hal_thread.h"
+#include "hal_time.h"
+#include "hal_timer.h"
+
+
+/* kernel struct termios2 (generic layout): <asm/termbits.h> conflicts with <termios.h> */
+struct sTermios2 {
+	tcflag_t c_iflag;
+	tcflag_t c_oflag;
+	tcflag_t c_cflag;
+	tcflag_t c_lflag;
+	cc_t c_line;
+	cc_t c_cc[19];
+	speed_t c_ispeed;
+	speed_t c_ospeed;
+};
+
+#ifndef BOTHER
+#define BOTHER			0010000
+#endif
+#define SERIAL_TCGETS2	_IOR('T', 0x2A, struct sTermios2)
+#define SERIAL_TCSETS2	_IOW('T', 0x2B, struct sTermios2)
 
 
 typedef enum {
 	CREATED, INITED, OPENED
 } PortState;
 
+struct sSerialTxQueue {
+	HalPoll poll;
+	int fd;				// duplicate of the port descriptor: polled for HAL_POLLOUT
+	Timer timer;		// transmission completion check
+	uint8_t *buf;
+	int size;
+	int head;
+	int count;
+	bool pollout;		// HAL_POLLOUT is requested
+	bool pending;		// transmission is not completed
+	bool broken;		// the port is hung up
+	void *user;
+	SerialPortTxHandler handler;
+};
+
+
+typedef struct {
+	uint64_t timestamp;	// arrival time, ns
+	uint64_t end;		// ring position after the chunk
+} SerialRxChunk;
+
+/* single producer (the thread) / single consumer ring of the received bytes */
+struct sSerialRxRing {
+	Thread thread;
+	Signal event;		// readable while the ring is not empty
+	uint8_t *buf;
+	uint32_t size;		// power of two
+	SerialRxChunk *chunks;
+	uint32_t chunkCount;	// power of two
+	uint64_t head;		// consumer: ring position
+	uint64_t chunkHead;	// consumer: chunk index
+	uint64_t tail;		// producer: ring position
+	uint64_t chunkTail;	// producer: chunk index
+	int broken;			// the port is hung up
+};
+
+#define SERIAL_CAPTURE_RING_SIZE	(64 * 1024)	// per direction
+#define SERIAL_CAPTURE_SNAPLEN		4096
+#define SERIAL_CAPTURE_PAD			0xFFFFFFFF	// the rest of the ring is skipped
+#define SERIAL_CAPTURE_LINKTYPE		147			// LINKTYPE_USER0
+
+enum { CAPTURE_RX, CAPTURE_TX };
+
+typedef struct {
+	uint32_t size;		// captured
+	uint32_t origSize;
+	uint64_t timestamp;	// monotonic, ns
+} SerialCaptureRecord;
+
+/*
+ * producers are serialised by the lock (e.g. SerialPort_write of the application thread
+ * and the transmit queue drained by the poll thread) / single consumer (the writer)
+ */
+typedef struct {
+	uint8_t *buf;
+	uint64_t head;
+	uint64_t tail;
+	int lock;
+} SerialCaptureRing;
+
+struct sSerialCapture {
+	Thread thread;
+	FILE *file;
+	int active;			// the records are appended
+	int stop;
+	int64_t timeOffset;	// realtime - monotonic, ns
+	SerialCaptureRing rings[2];
+};
 
 struct sSerialPort {
 	char interfaceName[32];
@@ -26,11 +122,73 @@ struct sSerialPort {
 	char parity;
 	uint8_t stopBits;
 	struct timeval timeout;
+	int frameGap;		// in us, 0 - t3.5 by baud rate
+	bool lowLatency;
+	SerialPortRs485 rs485;
+	bool pty;			// descriptor of the pty pair: kept open until destroy
+	bool simulateLine;	// pty: the written data is delivered at the baud rate
+	uint64_t lineFreeAt;	// pty: end of the simulated transmission, in ns
+	struct sSerialTxQueue *txq;
+	struct sSerialRxRing *rxr;
+	struct sSerialCapture *cap;	// allocated by the first capture, kept until destroy
 	SerialPortError lastError;
 	PortState state;
 };
 
 
+/* the holder only copies a record: spin shortly, then give the CPU to it */
+static void SerialPort_lockCapture(SerialCaptureRing *r)
+{
+	int spins = 0;
+	while (__atomic_exchange_n(&r->lock, 1, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(&r->lock, __ATOMIC_RELAXED)) {
+			if (++spins > 100) {
+				sched_yield();
+				continue;
+			}
+#if defined(__x86_64__) || defined(__i386__)
+			__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+			__asm__ __volatile__("yield");
+#endif
+		}
+	}
+}
+
+/* timestamp 0 - now */
+static void SerialPort_capture(SerialPort self, int dir, uint64_t timestamp, const uint8_t *data, int size)
+{
+	struct sSerialCapture *c = __atomic_load_n(&self->cap, __ATOMIC_ACQUIRE);
+	if (c == NULL || size <= 0 || !__atomic_load_n(&c->active, __ATOMIC_ACQUIRE)) return;
+
+	SerialCaptureRing *r = &(c->rings[dir]);
+	uint32_t len = (size < SERIAL_CAPTURE_SNAPLEN)? (uint32_t)size : SERIAL_CAPTURE_SNAPLEN;
+	uint32_t rec = (uint32_t)((sizeof(SerialCaptureRecord) + len + 7) & ~7u);
+	SerialPort_lockCapture(r);
+	if (timestamp == 0) timestamp = Hal_getMonotonicTimeInNs(); // in the order of the records
+	uint64_t tail = r->tail; // own
+	uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	uint32_t off = (uint32_t)(tail & (SERIAL_CAPTURE_RING_SIZE - 1));
+	uint32_t skip = (off + rec > SERIAL_CAPTURE_RING_SIZE)? SERIAL_CAPTURE_RING_SIZE - off : 0;
+	if (tail + skip + rec - head > SERIAL_CAPTURE_RING_SIZE) { // full: not captured
+		__atomic_store_n(&r->lock, 0, __ATOMIC_RELEASE);
+		return;
+	}
+
+	if (skip) {
+		*((uint32_t *)(r->buf + off)) = SERIAL_CAPTURE_PAD;
+		tail += skip;
+		off = 0;
+	}
+	SerialCaptureRecord *hdr = (SerialCaptureRecord *)(r->buf + off);
+	hdr->size = len;
+	hdr->origSize = (uint32_t)size;
+	hdr->timestamp = timestamp;
+	memcpy(r->buf + off + sizeof(SerialCaptureRecord), data, len);
+	__atomic_store_n(&r->tail, tail + rec, __ATOMIC_RELEASE);
+	__atomic_store_n(&r->lock, 0, __ATOMIC_RELEASE);
+}
+
 SerialPort SerialPort_create(const char *interfaceName)
 {
 	if (interfaceName == NULL) return NULL;
@@ -52,9 +210,13 @@ SerialPort SerialPort_create(const char *interfaceName)
 
 static void SerialPort_checkAndClose(SerialPort self)
 {
+	SerialPort_detachTxQueue(self);
+	SerialPort_stopRxRing(self);
 	if (self->state > INITED) {
-		close(self->fd);
-		self->fd = -1;
+		if (!self->pty) {
+			close(self->fd);
+			self->fd = -1;
+		}
 		self->state = INITED;
 	}
 }
@@ -64,7 +226,7 @@ bool SerialPort_reinit(SerialPort self, int baudRate, uint8_t dataBits, char par
 	if (self == NULL) return false;
 	SerialPort_checkAndClose(self);
 	self->state = INITED;
-	self->fd = -1;
+	if (!self->pty) self->fd = -1;
 	self->baudRate = baudRate;
 	self->dataBits = dataBits;
 	self->stopBits = stopBits;
@@ -77,16 +239,52 @@ void SerialPort_destroy(SerialPort self)
 {
 	if (self == NULL) return;
 	SerialPort_checkAndClose(self);
+	if (self->pty) close(self->fd);
+	SerialPort_stopCapture(self);
+	if (self->cap) {
+		free(self->cap->rings[CAPTURE_RX].buf);
+		free(self->cap->rings[CAPTURE_TX].buf);
+		free(self->cap);
+	}
 	free(self);
 }
 
+static bool SerialPort_applyRs485(SerialPort self)
+{
+	struct serial_rs485 rs;
+	memset(&rs, 0, sizeof(rs));
+	if (self->rs485.enabled) {
+		rs.flags = SER_RS485_ENABLED;
+		if (self->rs485.rtsOnSend) rs.flags |= SER_RS485_RTS_ON_SEND;
+		if (self->rs485.rtsAfterSend) rs.flags |= SER_RS485_RTS_AFTER_SEND;
+		if (self->rs485.rxDuringTx) rs.flags |= SER_RS485_RX_DURING_TX;
+		rs.delay_rts_before_send = self->rs485.delayBeforeSendInMs;
+		rs.delay_rts_after_send = self->rs485.delayAfterSendInMs;
+	}
+	return (ioctl(self->fd, TIOCSRS485, &rs) == 0);
+}
+
+static bool SerialPort_applyLowLatency(SerialPort self)
+{
+	struct serial_struct ss;
+	if (ioctl(self->fd, TIOCGSERIAL, &ss) < 0) return false;
+	if (self->lowLatency) {
+		ss.flags |= ASYNC_LOW_LATENCY;
+	} else {
+		ss.flags &= ~ASYNC_LOW_LATENCY;
+	}
+	return (ioctl(self->fd, TIOCSSERIAL, &ss) == 0);
+}
+
 bool SerialPort_open(SerialPort self)
 {
 	if (self == NULL) return false;
 
 	self->lastError = SERIAL_PORT_ERROR_NONE;
 
-	self->fd = open(self->interfaceName, O_RDWR | O_NOCTTY | O_NDELAY | O_EXCL);
+	if (!self->pty) {
+		self->fd = open(self->interfaceName, O_RDWR | O_NOCTTY | O_NDELAY | O_EXCL);
+	}
 	if (self->fd < 0) {
 		self->lastError = SERIAL_PORT_ERROR_OPEN_FAILED;
 		return false;
@@ -94,6 +292,12 @@ bool SerialPort_open(SerialPort self)
 
 	struct termios tios;
 	speed_t baudrate;
+	bool customBaudRate = false;
+
+	if (self->baudRate <= 0) {
+		self->lastError = SERIAL_PORT_ERROR_INVALID_BAUDRATE;
+		goto exit_error;
+	}
 
 	tcgetattr(self->fd, &tios);
 
@@ -176,8 +380,9 @@ bool SerialPort_open(SerialPort self)
 		case 4000000: baudrate = B4000000; break;
 		#endif
 		default:
+			// set by termios2 below
 			baudrate = B9600;
-			self->lastError = SERIAL_PORT_ERROR_INVALID_BAUDRATE;
+			customBaudRate = true;
 			break;
 	}
 
@@ -219,12 +424,83 @@ bool SerialPort_open(SerialPort self)
 		goto exit_error;
 	}
 
+	if (customBaudRate) {
+		struct sTermios2 tios2;
+		if (ioctl(self->fd, SERIAL_TCGETS2, &tios2) < 0) {
+			self->lastError = SERIAL_PORT_ERROR_INVALID_BAUDRATE;
+			goto exit_error;
+		}
+		tios2.c_cflag &= ~CBAUD;
+		tios2.c_cflag |= BOTHER;
+		tios2.c_ispeed = (speed_t)self->baudRate;
+		tios2.c_ospeed = (speed_t)self->baudRate;
+		if (ioctl(self->fd, SERIAL_TCSETS2, &tios2) < 0) {
+			self->lastError = SERIAL_PORT_ERROR_INVALID_BAUDRATE;
+			goto exit_error;
+		}
+	}
+
+	if (self->lowLatency) {
+		// best effort: not all drivers support it
+		SerialPort_applyLowLatency(self);
+	}
+
+	if (self->rs485.enabled && !SerialPort_applyRs485(self)) {
+		self->lastError = SERIAL_PORT_ERROR_INVALID_ARGUMENT;
+		goto exit_error;
+	}
+
 	self->state = OPENED;
 	return true;
 
 exit_error:
-	close(self->fd);
-	self->fd = -1;
+	if (!self->pty) {
+		close(self->fd);
+		self->fd = -1;
+	}
+	return false;
+}
+
+bool SerialPort_createPtyPair(SerialPort *first, SerialPort *second, bool simulateLine)
+{
+	if (first == NULL || second == NULL) return false;
+	*first = NULL;
+	*second = NULL;
+
+	char name[32];
+	int unlock = 0;
+	int ptn = -1;
+	int sfd = -1;
+	SerialPort m = NULL;
+	SerialPort s = NULL;
+
+	int mfd = open("/dev/ptmx", O_RDWR | O_NOCTTY | O_NDELAY);
+	if (mfd < 0) return false;
+	if (ioctl(mfd, TIOCSPTLCK, &unlock) < 0 || ioctl(mfd, TIOCGPTN, &ptn) < 0) goto exit_error;
+	snprintf(name, sizeof(name), "/dev/pts/%d", ptn);
+	sfd = open(name, O_RDWR | O_NOCTTY | O_NDELAY);
+	if (sfd < 0) goto exit_error;
+
+	m = SerialPort_create("/dev/ptmx");
+	s = SerialPort_create(name);
+	if (m == NULL || s == NULL) goto exit_error;
+	m->fd = mfd;
+	s->fd = sfd;
+	m->pty = s->pty = true;
+	m->simulateLine = s->simulateLine = simulateLine;
+	mfd = sfd = -1; // owned by the ports
+	// the termios of the master are the ones of the slave
+	if (!SerialPort_reinit(m, 9600, 8, 'N', 1) || !SerialPort_open(m)) goto exit_error;
+	if (!SerialPort_reinit(s, 9600, 8, 'N', 1) || !SerialPort_open(s)) goto exit_error;
+	*first = m;
+	*second = s;
+	return true;
+
+exit_error:
+	SerialPort_destroy(m);
+	SerialPort_destroy(s);
+	if (mfd >= 0) close(mfd);
+	if (sfd >= 0) close(sfd);
 	return false;
 }
 
@@ -262,39 +538,352 @@ static int SerialPort_readByteTimeout(SerialPort self, struct timeval *timeout)
 int SerialPort_readByte(SerialPort self)
 {
 	if (self == NULL) return -1;
-	if (self->fd == -1) return -1;
+	if (self->fd == -1 || self->rxr) return -1;
 	struct timeval timeout = self->timeout;
-	return SerialPort_readByteTimeout(self, &timeout);
+	int ret = SerialPort_readByteTimeout(self, &timeout);
+	if (ret >= 0) {
+		uint8_t byte = (uint8_t)ret;
+		SerialPort_capture(self, CAPTURE_RX, 0, &byte, 1);
+	}
+	return ret;
+}
+
+/*
+ * Read the bytes available up to size. If wait is true or there is nothing to read,
+ * waits for the first byte. Returns 0 on timeout.
+ */
+static int SerialPort_readChunkTimeout(SerialPort self, uint8_t *buf, int size, struct timeval *timeout, bool wait)
+{
+	int rc;
+	fd_set set;
+
+	self->lastError = SERIAL_PORT_ERROR_NONE;
+
+	if (!wait) {
+		rc = read(self->fd, buf, size);
+		if (rc > 0) return rc;
+		if (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			self->lastError = SERIAL_PORT_ERROR_UNKNOWN;
+			return -1;
+		}
+	}
+
+	FD_ZERO(&set);
+	FD_SET(self->fd, &set);
+
+	int ret = select(self->fd+1, &set, NULL, NULL, timeout);
+
+	if (ret == -1) {
+		self->lastError = SERIAL_PORT_ERROR_UNKNOWN;
+		return -1;
+	} else if (ret == 0) {
+		return 0;
+	} else {
+		rc = read(self->fd, buf, size);
+		if (rc > 0) return rc;
+		if (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			self->lastError = SERIAL_PORT_ERROR_UNKNOWN;
+			return -1;
+		}
+		return 0;
+	}
 }
 
 int SerialPort_read(SerialPort self, uint8_t *buffer, int bufSize)
 {
 	if (self == NULL || buffer == NULL) return -1;
-	if (self->fd == -1) return -1;
+	if (self->fd == -1 || self->rxr) return -1;
 
-	int i;
+	int i = 0;
 	int res;
 	struct timeval timeout = self->timeout;
 
-	for (i = 0; i < bufSize; ++i) {
-		res = SerialPort_readByteTimeout(self, &timeout);
-		if (res >= 0) {
-			buffer[i] = (uint8_t)res;
-		} else {
-			break;
-		}
+	self->lastError = SERIAL_PORT_ERROR_NONE;
+	while (i < bufSize) {
+		// the input is drained after the first chunk: wait for the next one
+		res = SerialPort_readChunkTimeout(self, buffer + i, bufSize - i, &timeout, (i > 0));
+		if (res <= 0) break;
+		i += res;
 	}
 
 	if (self->lastError != SERIAL_PORT_ERROR_NONE) return -1;
+	SerialPort_capture(self, CAPTURE_RX, 0, buffer, i);
 	return i;
 }
 
+int SerialPort_readBulk(SerialPort self, uint8_t *buffer, int bufSize)
+{
+	if (self == NULL || buffer == NULL || bufSize <= 0) return -1;
+	if (self->fd == -1 || self->rxr) return -1;
+	struct timeval timeout = self->timeout;
+	int ret = SerialPort_readChunkTimeout(self, buffer, bufSize, &timeout, false);
+	SerialPort_capture(self, CAPTURE_RX, 0, buffer, ret);
+	return ret;
+}
+
+static inline int SerialPort_getCharBits(SerialPort self)
+{
+	return 1 + self->dataBits + ((self->parity != 'N')? 1 : 0) + self->stopBits;
+}
+
+int SerialPort_getFrameGap(SerialPort self)
+{
+	if (self == NULL || self->baudRate <= 0) return -1;
+	if (self->frameGap > 0) return self->frameGap;
+	if (self->baudRate > 19200) return 1750; // fixed by Modbus RTU for the high rates
+	int bits = SerialPort_getCharBits(self);
+	// 3.5 characters rounded up
+	return (int)((35LL * bits * 1000000LL + 10LL * self->baudRate - 1) / (10LL * self->baudRate));
+}
+
+void SerialPort_setFrameGap(SerialPort self, int gapInUs)
+{
+	if (self == NULL) return;
+	self->frameGap = (gapInUs > 0)? gapInUs : 0;
+}
+
+int SerialPort_readFrame(SerialPort self, uint8_t *buffer, int bufSize, uint64_t *timestampInNs)
+{
+	if (self == NULL || buffer == NULL || bufSize <= 0) return -1;
+	if (self->fd == -1 || self->rxr) return -1;
+
+	struct timeval timeout = self->timeout;
+	int cnt = SerialPort_readChunkTimeout(self, buffer, bufSize, &timeout, false);
+	if (cnt <= 0) return cnt;
+	uint64_t timestamp = Hal_getMonotonicTimeInNs();
+	if (timestampInNs) *timestampInNs = timestamp;
+
+	// VTIME has 0.1 s resolution: the gap is measured by select
+	int gap = SerialPort_getFrameGap(self);
+	uint8_t scratch[256];
+	fd_set set;
+
+	while (1) {
+		struct timeval tv = { .tv_sec = gap / 1000000, .tv_usec = gap % 1000000 };
+		FD_ZERO(&set);
+		FD_SET(self->fd, &set);
+		int ret = select(self->fd+1, &set, NULL, NULL, &tv);
+		if (ret == 0) break; // silence: end of the frame
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			self->lastError = SERIAL_PORT_ERROR_UNKNOWN;
+			return -1;
+		}
+		// the overflow is discarded
+		uint8_t *dst = (cnt < bufSize)? buffer + cnt : scratch;
+		int room = (cnt < bufSize)? bufSize - cnt : (int)sizeof(scratch);
+		int rc = read(self->fd, dst, room);
+		if (rc < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) continue;
+			self->lastError = SERIAL_PORT_ERROR_UNKNOWN;
+			return -1;
+		}
+		if (rc == 0) break;
+		if (dst != scratch) cnt += rc;
+	}
+	SerialPort_capture(self, CAPTURE_RX, timestamp, buffer, cnt);
+	return cnt;
+}
+
+static void *SerialPort_rxRingThread(void *parameter)
+{
+	SerialPort self = (SerialPort)parameter;
+	struct sSerialRxRing *r = self->rxr;
+	int cfd = HalSignal_getDescriptor(HalThread_getCancelSignal(r->thread)).i32;
+	int maxfd = (cfd > self->fd)? cfd : self->fd;
+	fd_set set;
+
+	while (1) {
+		uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		uint64_t chunkHead = __atomic_load_n(&r->chunkHead, __ATOMIC_ACQUIRE);
+		bool full = (r->tail - head == r->size || r->chunkTail - chunkHead == r->chunkCount);
+		struct timeval tv = { .tv_sec = 0, .tv_usec = 1000 }; // full: recheck the consumer
+
+		FD_ZERO(&set);
+		FD_SET(cfd, &set);
+		if (!full) FD_SET(self->fd, &set);
+		int ret = select(maxfd+1, &set, NULL, NULL, (full)? &tv : NULL);
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		if (FD_ISSET(cfd, &set)) break;
+		if (ret == 0) continue;
+
+		uint64_t timestamp = Hal_getMonotonicTimeInNs();
+		uint64_t tail = r->tail;
+		uint32_t room = r->size - (uint32_t)(tail - head);
+		ssize_t rc = 0;
+		while (room > 0) {
+			// up to the end of the ring, then from the start with the same timestamp
+			uint32_t off = (uint32_t)(tail & (r->size - 1));
+			uint32_t n = (room < r->size - off)? room : r->size - off;
+			rc = read(self->fd, r->buf + off, n);
+			if (rc <= 0) break;
+			tail += rc;
+			room -= rc;
+			if ((uint32_t)rc < n) break;
+		}
+		if (tail != r->tail) {
+			uint32_t off = (uint32_t)(r->tail & (r->size - 1));
+			uint32_t n = (uint32_t)(tail - r->tail);
+			uint32_t first = (n < r->size - off)? n : r->size - off;
+			SerialPort_capture(self, CAPTURE_RX, timestamp, r->buf + off, (int)first);
+			SerialPort_capture(self, CAPTURE_RX, timestamp, r->buf, (int)(n - first));
+			SerialRxChunk *c = &(r->chunks[r->chunkTail & (r->chunkCount - 1)]);
+			c->timestamp = timestamp;
+			c->end = tail;
+			__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+			__atomic_store_n(&r->chunkTail, r->chunkTail + 1, __ATOMIC_RELEASE);
+			HalSignal_raise(r->event);
+		} else if (rc == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+			break; // hung up
+		}
+	}
+	__atomic_store_n(&r->broken, 1, __ATOMIC_RELEASE);
+	HalSignal_raise(r->event);
+	return NULL;
+}
+
+bool SerialPort_startRxRing(SerialPort self, int size)
+{
+	if (self == NULL || self->fd == -1 || self->rxr || size <= 0) return false;
+	uint32_t ringSize = 64;
+	while (ringSize < (uint32_t)size && ringSize < 0x40000000) ringSize <<= 1;
+
+	struct sSerialRxRing *r = (struct sSerialRxRing *)calloc(1, sizeof(struct sSerialRxRing));
+	if (r == NULL) return false;
+	r->size = ringSize;
+	r->chunkCount = ringSize / 4; // a chunk is a few bytes at least on the fast lines
+	r->buf = (uint8_t *)malloc(r->size);
+	if (r->buf == NULL) goto exit_error;
+	r->chunks = (SerialRxChunk *)malloc(r->chunkCount * sizeof(SerialRxChunk));
+	if (r->chunks == NULL) goto exit_error;
+	r->event = HalSignal_create();
+	if (r->event == NULL) goto exit_error;
+	r->thread = HalThread_create(0, SerialPort_rxRingThread, self, false);
+	if (r->thread == NULL) goto exit_error;
+	HalThread_setName(r->thread, "halserialrx");
+	self->rxr = r;
+	HalThread_start(r->thread);
+	return true;
+
+exit_error:
+	HalSignal_destroy(r->event);
+	free(r->chunks);
+	free(r->buf);
+	free(r);
+	return false;
+}
+
+void SerialPort_stopRxRing(SerialPort self)
+{
+	if (self == NULL || self->rxr == NULL) return;
+	struct sSerialRxRing *r = self->rxr;
+	HalThread_cancel(r->thread);
+	HalThread_destroy(r->thread); // joins
+	HalSignal_destroy(r->event);
+	free(r->chunks);
+	free(r->buf);
+	free(r);
+	self->rxr = NULL;
+}
+
+unidesc SerialPort_getRxRingDescriptor(SerialPort self)
+{
+	if (self == NULL || self->rxr == NULL) return Hal_getInvalidUnidesc();
+	return HalSignal_getDescriptor(self->rxr->event);
+}
+
+int SerialPort_peekRxRing(SerialPort self, const uint8_t **data, uint64_t *timestampInNs)
+{
+	if (self == NULL || self->rxr == NULL || data == NULL) return -1;
+	struct sSerialRxRing *r = self->rxr;
+	uint64_t chunkTail = __atomic_load_n(&r->chunkTail, __ATOMIC_ACQUIRE);
+	if (r->chunkHead == chunkTail) {
+		// clear the event, then check the chunks published meanwhile
+		HalSignal_end(r->event);
+		int broken = __atomic_load_n(&r->broken, __ATOMIC_ACQUIRE);
+		chunkTail = __atomic_load_n(&r->chunkTail, __ATOMIC_ACQUIRE);
+		if (r->chunkHead == chunkTail) {
+			if (broken) {
+				HalSignal_raise(r->event); // keep reporting the hang up
+				return -1;
+			}
+			return 0;
+		}
+	}
+	const SerialRxChunk *c = &(r->chunks[r->chunkHead & (r->chunkCount - 1)]);
+	uint32_t off = (uint32_t)(r->head & (r->size - 1));
+	uint64_t cnt = c->end - r->head;
+	if (cnt > r->size - off) cnt = r->size - off;
+	*data = r->buf + off;
+	if (timestampInNs) *timestampInNs = c->timestamp;
+	return (int)cnt;
+}
+
+void SerialPort_consumeRxRing(SerialPort self, int size)
+{
+	if (self == NULL || self->rxr == NULL || size <= 0) return;
+	struct sSerialRxRing *r = self->rxr;
+	uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	uint64_t chunkTail = __atomic_load_n(&r->chunkTail, __ATOMIC_ACQUIRE);
+	uint64_t head = r->head + (uint64_t)size;
+	if (head > tail) head = tail;
+	uint64_t chunkHead = r->chunkHead;
+	while (chunkHead != chunkTail && r->chunks[chunkHead & (r->chunkCount - 1)].end <= head) {
+		chunkHead++;
+	}
+	__atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+	__atomic_store_n(&r->chunkHead, chunkHead, __ATOMIC_RELEASE);
+}
+
+static uint64_t SerialPort_getLineTime(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* pty pair: deliver the data in ~1 ms chunks when it would be received on a real line */
+static int SerialPort_writeSimulated(SerialPort self, const uint8_t *buf, int size)
+{
+	uint64_t charTime = (uint64_t)SerialPort_getCharBits(self) * 1000000000ULL / (uint64_t)self->baudRate;
+	int chunk = (charTime < 1000000)? (int)(1000000 / charTime) : 1;
+	uint64_t now = SerialPort_getLineTime();
+	if (self->lineFreeAt < now) self->lineFreeAt = now;
+
+	int sent = 0;
+	while (sent < size) {
+		int n = (size - sent < chunk)? size - sent : chunk;
+		self->lineFreeAt += (uint64_t)n * charTime;
+		struct timespec ts = {
+			.tv_sec = (time_t)(self->lineFreeAt / 1000000000ULL),
+			.tv_nsec = (long)(self->lineFreeAt % 1000000000ULL)
+		};
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+		ssize_t rc = write(self->fd, buf + sent, n);
+		if (rc < 0) {
+			if (errno == EINTR) continue;
+			return (sent > 0)? sent : -1;
+		}
+		sent += (int)rc;
+	}
+	return sent;
+}
+
 int SerialPort_write(SerialPort self, uint8_t *buffer, int bufSize)
 {
 	if (self == NULL || buffer == NULL) return -1;
 	if (self->fd == -1) return -1;
 	self->lastError = SERIAL_PORT_ERROR_NONE;
-	ssize_t result = write(self->fd, buffer, bufSize);
+	ssize_t result;
+	if (self->simulateLine && self->baudRate > 0) {
+		result = SerialPort_writeSimulated(self, buffer, bufSize);
+	} else {
+		result = write(self->fd, buffer, bufSize);
+	}
+	SerialPort_capture(self, CAPTURE_TX, 0, buffer, (int)result);
 	return result;
 }
 
@@ -305,6 +894,185 @@ int SerialPort_writeAndWait(SerialPort self, uint8_t *buffer, int bufSize)
 	return result;
 }
 
+/* check the completion after the time to transmit the given number of characters */
+static void SerialPort_armTxCheck(SerialPort self, int chars)
+{
+	struct sSerialTxQueue *q = self->txq;
+	uint64_t ns = (uint64_t)SerialPort_getCharBits(self) * 1000000000ULL / (uint64_t)self->baudRate;
+	ns *= (chars > 0)? (uint64_t)chars : 1;
+	if (ns < 100000) ns = 100000;
+	AccurateTime_t timeout;
+	timeout.sec = (uint32_t)(ns / 1000000000ULL);
+	timeout.nsec = (uint32_t)(ns % 1000000000ULL);
+	Timer_setTimeout(q->timer, &timeout);
+}
+
+static void SerialPort_flushTxQueue(SerialPort self)
+{
+	struct sSerialTxQueue *q = self->txq;
+	while (q->count > 0) {
+		int chunk = (q->count < q->size - q->head)? q->count : q->size - q->head;
+		int rc = write(self->fd, q->buf + q->head, chunk);
+		if (rc <= 0) break; // full or broken: see the poll events
+		SerialPort_capture(self, CAPTURE_TX, 0, q->buf + q->head, rc);
+		q->head = (q->head + rc) % q->size;
+		q->count -= rc;
+		if (rc < chunk) break;
+	}
+	bool pollout = (q->count > 0);
+	if (pollout != q->pollout) {
+		unidesc ud;
+		ud.i32 = q->fd;
+		HalPoll_update_1(q->poll, ud, (pollout)? HAL_POLLOUT : 0);
+		q->pollout = pollout;
+	}
+	if (!pollout && q->pending) {
+		int outq = 0;
+		ioctl(self->fd, TIOCOUTQ, &outq);
+		SerialPort_armTxCheck(self, outq + 1);
+	}
+}
+
+static void onTxPollEvent(void *user, void *object, int revents)
+{
+	SerialPort self = (SerialPort)object;
+	struct sSerialTxQueue *q = self->txq;
+	(void)user;
+	if (q == NULL || q->broken) return;
+	if (revents & (HAL_POLLERR | HAL_POLLHUP | HAL_POLLNVAL)) {
+		unidesc ud;
+		ud.i32 = q->fd;
+		HalPoll_remove(q->poll, ud);
+		Timer_stop(q->timer);
+		q->broken = true;
+		q->count = 0;
+		q->pending = false;
+		self->lastError = SERIAL_PORT_ERROR_UNKNOWN;
+		return;
+	}
+	SerialPort_flushTxQueue(self);
+}
+
+static void onTxTimer(void *user, void *object, int revents)
+{
+	SerialPort self = (SerialPort)object;
+	struct sSerialTxQueue *q = self->txq;
+	(void)user;
+	(void)revents;
+	if (q == NULL) return;
+	Timer_endEvent(q->timer);
+	if (q->count > 0 || !q->pending) return; // checked again after the queue is flushed
+	int outq = 0;
+	if (ioctl(self->fd, TIOCOUTQ, &outq) == 0 && outq > 0) {
+		SerialPort_armTxCheck(self, outq);
+		return;
+	}
+	// the last character may be in the shift register
+	int lsr = 0;
+	if (ioctl(self->fd, TIOCSERGETLSR, &lsr) == 0 && (lsr & TIOCSER_TEMT) == 0) {
+		SerialPort_armTxCheck(self, 1);
+		return;
+	}
+	q->pending = false;
+	if (q->handler) {
+		q->handler(q->user, self);
+	}
+}
+
+bool SerialPort_attachTxQueue(SerialPort self, HalPoll poll, int queueSize, void *user, SerialPortTxHandler handler)
+{
+	if (self == NULL || poll == NULL || queueSize <= 0) return false;
+	if (self->fd == -1 || self->txq) return false;
+
+	struct sSerialTxQueue *q = (struct sSerialTxQueue *)calloc(1, sizeof(struct sSerialTxQueue));
+	if (q == NULL) return false;
+	q->fd = -1;
+	q->poll = poll;
+	q->size = queueSize;
+	q->user = user;
+	q->handler = handler;
+	q->buf = (uint8_t *)malloc(queueSize);
+	if (q->buf == NULL) goto exit_error;
+	q->fd = fcntl(self->fd, F_DUPFD_CLOEXEC, 0);
+	if (q->fd < 0) goto exit_error;
+	q->timer = Timer_create();
+	if (q->timer == NULL) goto exit_error;
+
+	unidesc ud;
+	ud.i32 = q->fd;
+	if (!HalPoll_update(poll, ud, 0, self, NULL, onTxPollEvent)) goto exit_error;
+	if (!HalPoll_update(poll, Timer_getDescriptor(q->timer), HAL_POLLIN, self, NULL, onTxTimer)) {
+		HalPoll_remove(poll, ud);
+		goto exit_error;
+	}
+	self->txq = q;
+	return true;
+
+exit_error:
+	Timer_destroy(q->timer);
+	if (q->fd >= 0) close(q->fd);
+	free(q->buf);
+	free(q);
+	return false;
+}
+
+void SerialPort_detachTxQueue(SerialPort self)
+{
+	if (self == NULL || self->txq == NULL) return;
+	struct sSerialTxQueue *q = self->txq;
+	unidesc ud;
+	ud.i32 = q->fd;
+	if (!q->broken) {
+		HalPoll_remove(q->poll, ud);
+	}
+	HalPoll_remove(q->poll, Timer_getDescriptor(q->timer));
+	Timer_destroy(q->timer);
+	close(q->fd);
+	free(q->buf);
+	free(q);
+	self->txq = NULL;
+}
+
+int SerialPort_writeAsync(SerialPort self, const uint8_t *buffer, int bufSize)
+{
+	if (self == NULL || buffer == NULL || bufSize < 0) return -1;
+	if (self->fd == -1 || self->txq == NULL) return -1;
+	struct sSerialTxQueue *q = self->txq;
+	if (q->broken) return -1;
+	if (bufSize > q->size - q->count) return 0; // the message is not split
+
+	self->lastError = SERIAL_PORT_ERROR_NONE;
+	int done = 0;
+	if (q->count == 0) {
+		done = write(self->fd, buffer, bufSize);
+		if (done < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				self->lastError = SERIAL_PORT_ERROR_UNKNOWN;
+				return -1;
+			}
+			done = 0;
+		}
+		SerialPort_capture(self, CAPTURE_TX, 0, buffer, done);
+	}
+	int rest = bufSize - done;
+	int tail = (q->head + q->count) % q->size;
+	int part = (rest < q->size - tail)? rest : q->size - tail;
+	memcpy(q->buf + tail, buffer + done, part);
+	memcpy(q->buf, buffer + done + part, rest - part);
+	q->count += rest;
+	q->pending = true;
+	SerialPort_flushTxQueue(self);
+	return bufSize;
+}
+
+int SerialPort_getTxPending(SerialPort self)
+{
+	if (self == NULL || self->fd == -1) return -1;
+	int outq = 0;
+	if (ioctl(self->fd, TIOCOUTQ, &outq) < 0) return -1;
+	return outq + ((self->txq)? self->txq->count : 0);
+}
+
 unidesc SerialPort_getDescriptor(SerialPort self)
 {
 	if (self) {
@@ -326,6 +1094,9 @@ void SerialPort_discardInBuffer(SerialPort self)
 	if (self == NULL) return;
 	if (self->fd == -1) return;
 	tcflush(self->fd, TCIOFLUSH);
+	if (self->rxr) {
+		SerialPort_consumeRxRing(self, INT_MAX);
+	}
 }
 
 void SerialPort_setTimeout(SerialPort self, int timeout)
@@ -335,6 +1106,195 @@ void SerialPort_setTimeout(SerialPort self, int timeout)
 	self->timeout.tv_usec = (timeout % 1000) * 1000;
 }
 
+bool SerialPort_setLowLatency(SerialPort self, bool enable)
+{
+	if (self == NULL) return false;
+	self->lowLatency = enable;
+	if (self->fd == -1) return true;
+	return SerialPort_applyLowLatency(self);
+}
+
+bool SerialPort_setRs485(SerialPort self, const SerialPortRs485 *config)
+{
+	if (self == NULL || config == NULL) return false;
+	self->rs485 = *config;
+	if (self->fd == -1) return true;
+	return SerialPort_applyRs485(self);
+}
+
+bool SerialPort_setLatencyTimer(SerialPort self, int timeInMs)
+{
+	if (self == NULL || timeInMs < 1 || timeInMs > 255) return false;
+	char real[PATH_MAX];
+	char path[PATH_MAX + 64];
+	if (realpath(self->interfaceName, real) == NULL) return false;
+	// usb-serial drivers (ftdi_sio) expose the timer of the adapter buffer
+	snprintf(path, sizeof(path), "/sys/bus/usb-serial/devices/%s/latency_timer", basename(real));
+	FILE *f = fopen(path, "w");
+	if (f == NULL) return false;
+	bool ret = (fprintf(f, "%d", timeInMs) > 0);
+	ret = (fclose(f) == 0) && ret;
+	return ret;
+}
+
+static void SerialPort_writeCaptureBlock(struct sSerialCapture *c, uint32_t type, const void *body, uint32_t size)
+{
+	static const uint8_t zero[4] = { 0, 0, 0, 0 };
+	uint32_t total = 12 + ((size + 3) & ~3u);
+	fwrite(&type, 4, 1, c->file);
+	fwrite(&total, 4, 1, c->file);
+	fwrite(body, 1, size, c->file);
+	fwrite(zero, 1, ((size + 3) & ~3u) - size, c->file);
+	fwrite(&total, 4, 1, c->file);
+}
+
+/* the next record of the ring or NULL */
+static const SerialCaptureRecord *SerialPort_peekCapture(SerialCaptureRing *r)
+{
+	uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	if (r->head == tail) return NULL;
+	uint32_t off = (uint32_t)(r->head & (SERIAL_CAPTURE_RING_SIZE - 1));
+	if (*((const uint32_t *)(r->buf + off)) == SERIAL_CAPTURE_PAD) {
+		__atomic_store_n(&r->head, r->head + (SERIAL_CAPTURE_RING_SIZE - off), __ATOMIC_RELEASE);
+		if (r->head == tail) return NULL;
+		off = 0;
+	}
+	return (const SerialCaptureRecord *)(r->buf + off);
+}
+
+static void SerialPort_drainCapture(struct sSerialCapture *c)
+{
+	uint8_t epb[20 + SERIAL_CAPTURE_SNAPLEN + 12];
+	bool written = false;
+	while (1) {
+		// the older record of the two directions
+		const SerialCaptureRecord *rx = SerialPort_peekCapture(&(c->rings[CAPTURE_RX]));
+		const SerialCaptureRecord *tx = SerialPort_peekCapture(&(c->rings[CAPTURE_TX]));
+		if (rx == NULL && tx == NULL) break;
+		int dir = (tx == NULL || (rx && rx->timestamp <= tx->timestamp))? CAPTURE_RX : CAPTURE_TX;
+		const SerialCaptureRecord *rec = (dir == CAPTURE_RX)? rx : tx;
+
+		// enhanced packet block: interface, timestamp, lengths, data, epb_flags (direction)
+		uint64_t ts = (uint64_t)((int64_t)rec->timestamp + c->timeOffset);
+		uint32_t *w = (uint32_t *)epb;
+		uint32_t padded = (rec->size + 3) & ~3u;
+		w[0] = 0;
+		w[1] = (uint32_t)(ts >> 32);
+		w[2] = (uint32_t)ts;
+		w[3] = rec->size;
+		w[4] = rec->origSize;
+		memcpy(epb + 20, (const uint8_t *)rec + sizeof(SerialCaptureRecord), rec->size);
+		memset(epb + 20 + rec->size, 0, padded - rec->size);
+		uint16_t opt[2] = { 2, 4 };
+		uint32_t flags = (dir == CAPTURE_RX)? 1 : 2; // inbound, outbound
+		memcpy(epb + 20 + padded, opt, 4);
+		memcpy(epb + 24 + padded, &flags, 4);
+		memset(epb + 28 + padded, 0, 4); // opt_endofopt
+		SerialPort_writeCaptureBlock(c, 6, epb, 32 + padded);
+		written = true;
+
+		SerialCaptureRing *r = &(c->rings[dir]);
+		uint32_t recSize = (uint32_t)((sizeof(SerialCaptureRecord) + rec->size + 7) & ~7u);
+		__atomic_store_n(&r->head, r->head + recSize, __ATOMIC_RELEASE);
+	}
+	if (written) fflush(c->file);
+}
+
+static void *SerialPort_captureThread(void *parameter)
+{
+	struct sSerialCapture *c = (struct sSerialCapture *)parameter;
+	while (!__atomic_load_n(&c->stop, __ATOMIC_ACQUIRE)) {
+		HalThread_sleep(10);
+		SerialPort_drainCapture(c);
+	}
+	SerialPort_drainCapture(c);
+	return NULL;
+}
+
+bool SerialPort_startCapture(SerialPort self, const char *filename)
+{
+	if (self == NULL || filename == NULL) return false;
+	struct sSerialCapture *c = self->cap;
+	if (c && c->thread) return false;
+	if (c == NULL) {
+		c = (struct sSerialCapture *)calloc(1, sizeof(struct sSerialCapture));
+		if (c == NULL) return false;
+		c->rings[CAPTURE_RX].buf = (uint8_t *)malloc(SERIAL_CAPTURE_RING_SIZE);
+		c->rings[CAPTURE_TX].buf = (uint8_t *)malloc(SERIAL_CAPTURE_RING_SIZE);
+		if (c->rings[CAPTURE_RX].buf == NULL || c->rings[CAPTURE_TX].buf == NULL) {
+			free(c->rings[CAPTURE_RX].buf);
+			free(c->rings[CAPTURE_TX].buf);
+			free(c);
+			return false;
+		}
+		__atomic_store_n(&self->cap, c, __ATOMIC_RELEASE);
+	}
+	// the records left by the producers after the previous stop
+	for (int i = 0; i < 2; ++i) {
+		c->rings[i].head = __atomic_load_n(&c->rings[i].tail, __ATOMIC_ACQUIRE);
+	}
+
+	c->file = fopen(filename, "wb");
+	if (c->file == NULL) return false;
+
+	// section header block: byte order magic, version 1.0, unknown section length
+	uint8_t shb[16];
+	uint32_t magic = 0x1A2B3C4D;
+	uint16_t version[2] = { 1, 0 };
+	memcpy(shb, &magic, 4);
+	memcpy(shb + 4, version, 4);
+	memset(shb + 8, 0xFF, 8);
+	SerialPort_writeCaptureBlock(c, 0x0A0D0D0A, shb, sizeof(shb));
+	// interface description block: link type, snap length, if_name, if_tsresol (ns)
+	uint8_t idb[8 + 4 + sizeof(self->interfaceName) + 4 + 8 + 4];
+	uint32_t nameSize = (uint32_t)strlen(self->interfaceName);
+	uint32_t namePadded = (nameSize + 3) & ~3u;
+	uint16_t linkType[2] = { SERIAL_CAPTURE_LINKTYPE, 0 };
+	uint32_t snaplen = SERIAL_CAPTURE_SNAPLEN;
+	uint16_t optName[2] = { 2, (uint16_t)nameSize };
+	uint16_t optTsresol[2] = { 9, 1 };
+	uint8_t tsresol[4] = { 9, 0, 0, 0 };
+	uint8_t *o = idb;
+	memcpy(o, linkType, 4); o += 4;
+	memcpy(o, &snaplen, 4); o += 4;
+	memcpy(o, optName, 4); o += 4;
+	memset(o, 0, namePadded);
+	memcpy(o, self->interfaceName, nameSize); o += namePadded;
+	memcpy(o, optTsresol, 4); o += 4;
+	memcpy(o, tsresol, 4); o += 4;
+	memset(o, 0, 4); o += 4; // opt_endofopt
+	SerialPort_writeCaptureBlock(c, 0x00000001, idb, (uint32_t)(o - idb));
+	if (fflush(c->file) != 0) goto exit_error;
+
+	struct timespechal now;
+	Hal_getRealTimeSpec(&now);
+	c->timeOffset = (int64_t)((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec) - (int64_t)Hal_getMonotonicTimeInNs();
+	c->stop = 0;
+	c->thread = HalThread_create(0, SerialPort_captureThread, c, false);
+	if (c->thread == NULL) goto exit_error;
+	HalThread_setName(c->thread, "halserialcap");
+	HalThread_start(c->thread);
+	__atomic_store_n(&c->active, 1, __ATOMIC_RELEASE);
+	return true;
+
+exit_error:
+	fclose(c->file);
+	c->file = NULL;
+	return false;
+}
+
+void SerialPort_stopCapture(SerialPort self)
+{
+	if (self == NULL || self->cap == NULL || self->cap->thread == NULL) return;
+	struct sSerialCapture *c = self->cap;
+	__atomic_store_n(&c->active, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&c->stop, 1, __ATOMIC_RELEASE);
+	HalThread_destroy(c->thread); // joins after the last drain
+	c->thread = NULL;
+	fclose(c->file);
+	c->file = NULL;
+}
+
 SerialPortError SerialPort_getLastError(SerialPort self)
 {
 	if (self == NULL) return SERIAL_PORT_ERROR_UNKNOWN;
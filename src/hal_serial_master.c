@@ -0,0 +1,385 @@
+#include "hal_serial_master.h"
+#include "hal_timer.h"
+#include <errno.h>
+
+
+#define MASTER_CHAR_BITS 11 // the longest character: start, 8 data, parity, stop
+
+typedef struct {
+	uint8_t data[SERIAL_MASTER_FRAME_SIZE];
+	int size;
+	int expectedSize;
+	int timeout;
+	int retries;
+	void *user;
+	SerialMasterHandler handler;
+} MasterRequest;
+
+typedef enum {
+	LINE_IDLE,
+	LINE_SENDING,		// request is partly written, waiting for the room in the driver (HAL_POLLOUT)
+	LINE_WAIT,			// request is sent, waiting for the response
+	LINE_RECEIVING,		// the response is being received, waiting for the gap
+	LINE_TURNAROUND,	// request without the response is being sent
+	LINE_GUARD,			// silence before the next request
+	LINE_BROKEN			// the port is hung up: removed from the poll
+} LineState;
+
+typedef struct sMasterLine {
+	SerialMaster master;
+	SerialPort port;
+	Timer timer;
+	LineState state;
+	int attempt;
+	int txOffset;		// written part of the active request
+	MasterRequest *queue;
+	int queueSize;
+	int head;
+	int count;
+	uint8_t rx[SERIAL_MASTER_FRAME_SIZE];
+	int rxSize;
+	struct sMasterLine *next;
+} MasterLine;
+
+struct sSerialMaster {
+	HalPoll poll;
+	MasterLine *lines;
+};
+
+
+static MasterLine *findLine(SerialMaster self, SerialPort port)
+{
+	for (MasterLine *l = self->lines; l; l = l->next) {
+		if (l->port == port) return l;
+	}
+	return NULL;
+}
+
+static void armTimer(MasterLine *line, uint64_t timeInUs)
+{
+	AccurateTime_t timeout;
+	if (timeInUs == 0) timeInUs = 1;
+	timeout.sec = (uint32_t)(timeInUs / 1000000);
+	timeout.nsec = (uint32_t)((timeInUs % 1000000) * 1000);
+	Timer_setTimeout(line->timer, &timeout);
+}
+
+static uint64_t getTransmitTime(MasterLine *line, int size)
+{
+	int baudRate = SerialPort_getBaudRate(line->port);
+	if (baudRate <= 0) return 0;
+	return (uint64_t)size * MASTER_CHAR_BITS * 1000000ULL / (uint64_t)baudRate;
+}
+
+static uint64_t getGap(MasterLine *line)
+{
+	int gap = SerialPort_getFrameGap(line->port);
+	return (gap > 0)? (uint64_t)gap : 0;
+}
+
+static void startRequest(MasterLine *line);
+
+static void setOutputEvent(MasterLine *line, bool enable)
+{
+	HalPoll_update_1(line->master->poll, SerialPort_getDescriptor(line->port), HAL_POLLIN | ((enable)? HAL_POLLOUT : 0));
+}
+
+static void completeRequest(MasterLine *line, SerialMasterResult result)
+{
+	MasterRequest *req = &(line->queue[line->head]);
+	void *user = req->user;
+	SerialMasterHandler handler = req->handler;
+	bool early = (result == SERIAL_MASTER_OK && line->state == LINE_RECEIVING);
+
+	line->head = (line->head + 1) % line->queueSize;
+	line->count--;
+	line->attempt = 0;
+	Timer_stop(line->timer);
+	if (line->state == LINE_SENDING) {
+		setOutputEvent(line, false);
+	}
+	if (early) {
+		// the gap is not waited yet: keep the line silent before the next request
+		line->state = LINE_GUARD;
+		armTimer(line, getGap(line));
+	} else {
+		line->state = LINE_IDLE;
+	}
+
+	if (handler) {
+		handler(user, line->port, result, line->rx, (result == SERIAL_MASTER_OK)? line->rxSize : 0);
+	}
+	if (line->state == LINE_IDLE && line->count > 0) {
+		startRequest(line);
+	}
+}
+
+/* completes the queued requests without sending them */
+static void dropRequests(MasterLine *line, SerialMasterResult result)
+{
+	while (line->count > 0) {
+		MasterRequest *req = &(line->queue[line->head]);
+		line->head = (line->head + 1) % line->queueSize;
+		line->count--;
+		if (req->handler) {
+			req->handler(req->user, line->port, result, NULL, 0);
+		}
+	}
+}
+
+/* writes what the driver accepts, false in case of an error */
+static bool writeRequest(MasterLine *line)
+{
+	MasterRequest *req = &(line->queue[line->head]);
+	int rc = SerialPort_write(line->port, req->data + line->txOffset, req->size - line->txOffset);
+	if (rc < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+		rc = 0;
+	}
+	line->txOffset += rc;
+	return true;
+}
+
+static void requestSent(MasterLine *line)
+{
+	MasterRequest *req = &(line->queue[line->head]);
+	uint64_t txTime = getTransmitTime(line, req->size);
+	if (req->timeout > 0) {
+		line->state = LINE_WAIT;
+		armTimer(line, txTime + (uint64_t)req->timeout * 1000);
+	} else {
+		line->state = LINE_TURNAROUND;
+		armTimer(line, txTime + getGap(line));
+	}
+}
+
+static void startRequest(MasterLine *line)
+{
+	MasterRequest *req = &(line->queue[line->head]);
+	line->rxSize = 0;
+	line->txOffset = 0;
+	if (!writeRequest(line)) {
+		line->state = LINE_WAIT;
+		completeRequest(line, SERIAL_MASTER_ERROR);
+		return;
+	}
+	if (line->txOffset < req->size) {
+		// the driver output buffer is full: the rest is written on HAL_POLLOUT
+		line->state = LINE_SENDING;
+		setOutputEvent(line, true);
+		int pending = SerialPort_getTxPending(line->port);
+		if (pending < 0) pending = 0;
+		armTimer(line, getTransmitTime(line, pending + req->size) + (uint64_t)req->timeout * 1000 + getGap(line));
+		return;
+	}
+	requestSent(line);
+}
+
+static void onLineOutput(MasterLine *line)
+{
+	MasterRequest *req = &(line->queue[line->head]);
+	if (!writeRequest(line)) {
+		completeRequest(line, SERIAL_MASTER_ERROR);
+		return;
+	}
+	if (line->txOffset == req->size) {
+		setOutputEvent(line, false);
+		requestSent(line);
+	}
+}
+
+/* the port is hung up: the poll would report it again and again */
+static void breakLine(MasterLine *line)
+{
+	HalPoll_remove(line->master->poll, SerialPort_getDescriptor(line->port));
+	Timer_stop(line->timer);
+	line->state = LINE_BROKEN;
+	dropRequests(line, SERIAL_MASTER_ERROR);
+}
+
+static void onLineInput(void *user, void *object, int revents)
+{
+	MasterLine *line = (MasterLine *)object;
+	uint8_t drop[SERIAL_MASTER_FRAME_SIZE];
+	(void)user;
+
+	if (revents & (HAL_POLLHUP | HAL_POLLERR | HAL_POLLNVAL)) {
+		breakLine(line);
+		return;
+	}
+	if ((revents & HAL_POLLOUT) && line->state == LINE_SENDING) {
+		onLineOutput(line);
+	}
+	if ((revents & HAL_POLLIN) == 0) return;
+
+	if (line->state != LINE_WAIT && line->state != LINE_RECEIVING) {
+		// noise or late response
+		while (SerialPort_readBulk(line->port, drop, sizeof(drop)) > 0) {}
+		return;
+	}
+
+	int room = SERIAL_MASTER_FRAME_SIZE - line->rxSize;
+	int rc = (room > 0)?
+			SerialPort_readBulk(line->port, line->rx + line->rxSize, room) :
+			SerialPort_readBulk(line->port, drop, sizeof(drop)); // the overflow is discarded
+	if (rc <= 0) return;
+	if (room > 0) line->rxSize += rc;
+
+	line->state = LINE_RECEIVING;
+	MasterRequest *req = &(line->queue[line->head]);
+	if (req->expectedSize > 0 && line->rxSize >= req->expectedSize) {
+		completeRequest(line, SERIAL_MASTER_OK);
+	} else {
+		armTimer(line, getGap(line));
+	}
+}
+
+static void onLineTimer(void *user, void *object, int revents)
+{
+	MasterLine *line = (MasterLine *)object;
+	(void)user;
+	(void)revents;
+	Timer_endEvent(line->timer);
+
+	switch (line->state) {
+		case LINE_SENDING:
+			// the driver does not accept the data (e.g. the flow control)
+			completeRequest(line, SERIAL_MASTER_TIMEOUT);
+			break;
+		case LINE_WAIT: {
+			MasterRequest *req = &(line->queue[line->head]);
+			if (line->attempt < req->retries) {
+				line->attempt++;
+				startRequest(line);
+			} else {
+				completeRequest(line, SERIAL_MASTER_TIMEOUT);
+			}
+		} break;
+		case LINE_RECEIVING:
+			// the gap: end of the response
+			line->state = LINE_WAIT;
+			completeRequest(line, SERIAL_MASTER_OK);
+			break;
+		case LINE_TURNAROUND:
+			completeRequest(line, SERIAL_MASTER_OK);
+			break;
+		case LINE_GUARD:
+			line->state = LINE_IDLE;
+			if (line->count > 0) {
+				startRequest(line);
+			}
+			break;
+		default: break;
+	}
+}
+
+static void destroyLine(SerialMaster self, MasterLine *line)
+{
+	HalPoll_remove(self->poll, SerialPort_getDescriptor(line->port));
+	HalPoll_remove(self->poll, Timer_getDescriptor(line->timer));
+	Timer_destroy(line->timer);
+	free(line->queue);
+	free(line);
+}
+
+
+SerialMaster SerialMaster_create(HalPoll poll)
+{
+	if (poll == NULL) return NULL;
+	SerialMaster self = (SerialMaster)calloc(1, sizeof(struct sSerialMaster));
+	if (self) {
+		self->poll = poll;
+	}
+	return self;
+}
+
+bool SerialMaster_addPort(SerialMaster self, SerialPort port, int queueLength)
+{
+	if (self == NULL || port == NULL || queueLength <= 0) return false;
+	if (findLine(self, port)) return false;
+	if (Hal_unidescIsInvalid(SerialPort_getDescriptor(port))) return false;
+
+	MasterLine *line = (MasterLine *)calloc(1, sizeof(MasterLine));
+	if (line == NULL) return false;
+	line->master = self;
+	line->port = port;
+	line->state = LINE_IDLE;
+	line->queueSize = queueLength;
+	line->queue = (MasterRequest *)calloc(queueLength, sizeof(MasterRequest));
+	if (line->queue == NULL) goto exit_error;
+	line->timer = Timer_create();
+	if (line->timer == NULL) goto exit_error;
+
+	SerialPort_setTimeout(port, 0);
+	if (!HalPoll_update(self->poll, SerialPort_getDescriptor(port), HAL_POLLIN, line, self, onLineInput)) {
+		goto exit_error;
+	}
+	if (!HalPoll_update(self->poll, Timer_getDescriptor(line->timer), HAL_POLLIN, line, self, onLineTimer)) {
+		HalPoll_remove(self->poll, SerialPort_getDescriptor(port));
+		goto exit_error;
+	}
+	line->next = self->lines;
+	self->lines = line;
+	return true;
+
+exit_error:
+	Timer_destroy(line->timer);
+	free(line->queue);
+	free(line);
+	return false;
+}
+
+void SerialMaster_removePort(SerialMaster self, SerialPort port)
+{
+	if (self == NULL) return;
+	MasterLine **pp = &(self->lines);
+	while (*pp && (*pp)->port != port) {
+		pp = &((*pp)->next);
+	}
+	MasterLine *line = *pp;
+	if (line == NULL) return;
+	*pp = line->next;
+	dropRequests(line, SERIAL_MASTER_CANCELLED);
+	destroyLine(self, line);
+}
+
+bool SerialMaster_request(SerialMaster self, SerialPort port, const uint8_t *request, int size,
+		int expectedSize, int timeoutInMs, int retries, void *user, SerialMasterHandler handler)
+{
+	if (self == NULL || request == NULL) return false;
+	if (size <= 0 || size > SERIAL_MASTER_FRAME_SIZE) return false;
+	if (expectedSize < 0 || expectedSize > SERIAL_MASTER_FRAME_SIZE || timeoutInMs < 0 || retries < 0) return false;
+	MasterLine *line = findLine(self, port);
+	if (line == NULL || line->state == LINE_BROKEN || line->count >= line->queueSize) return false;
+
+	MasterRequest *req = &(line->queue[(line->head + line->count) % line->queueSize]);
+	memcpy(req->data, request, size);
+	req->size = size;
+	req->expectedSize = expectedSize;
+	req->timeout = timeoutInMs;
+	req->retries = retries;
+	req->user = user;
+	req->handler = handler;
+	line->count++;
+
+	if (line->state == LINE_IDLE) {
+		startRequest(line);
+	}
+	return true;
+}
+
+int SerialMaster_getQueued(SerialMaster self, SerialPort port)
+{
+	if (self == NULL) return -1;
+	MasterLine *line = findLine(self, port);
+	return (line)? line->count : -1;
+}
+
+void SerialMaster_destroy(SerialMaster self)
+{
+	if (self == NULL) return;
+	while (self->lines) {
+		SerialMaster_removePort(self, self->lines->port);
+	}
+	free(self);
+}
@@ -6,6 +6,7 @@
 #include <string.h>
 
 #include "hal_serial.h"
+#include "hal_time.h"
 #include "hal_syshelper.h"
 #include <winsock2.h>
 #include <windows.h>
@@ -25,6 +26,8 @@ struct sSerialPort {
 	char parity;
 	uint8_t stopBits;
 	int timeout;
+	int frameGap;		// in us, 0 - t3.5 by baud rate
+	bool rs485;
 	SerialPortError lastError;
 	PortState state;
 };
@@ -49,6 +52,15 @@ SerialPort SerialPort_create(const char *interfaceName)
 	return self;
 }
 
+bool SerialPort_createPtyPair(SerialPort *first, SerialPort *second, bool simulateLine)
+{
+	// no pseudo terminals: use a virtual port pair driver (com0com)
+	(void)simulateLine;
+	if (first) *first = NULL;
+	if (second) *second = NULL;
+	return false;
+}
+
 static void SerialPort_checkAndClose(SerialPort self)
 {
 	if (self->state > INITED) {
@@ -148,8 +160,12 @@ bool SerialPort_open(SerialPort self)
 		case 921600: baudrate = CBR_921600; break;
 		#endif
 		default:
-			baudrate = CBR_9600;
-			self->lastError = SERIAL_PORT_ERROR_INVALID_BAUDRATE;
+			// the driver sets the divisor
+			if (self->baudRate <= 0) {
+				self->lastError = SERIAL_PORT_ERROR_INVALID_BAUDRATE;
+				goto exit_error;
+			}
+			baudrate = (DWORD)self->baudRate;
 			break;
 	}
 	serialParams.BaudRate = baudrate;
@@ -170,6 +186,10 @@ bool SerialPort_open(SerialPort self)
 	else /* 'O' */
 		serialParams.Parity = ODDPARITY;
 
+	if (self->rs485) {
+		serialParams.fRtsControl = RTS_CONTROL_TOGGLE;
+	}
+
 	if (SetCommState(self->h, &serialParams) == FALSE) {
 		self->lastError = SERIAL_PORT_ERROR_INVALID_ARGUMENT;
 		goto exit_error;
@@ -274,6 +294,112 @@ int SerialPort_read(SerialPort self, uint8_t *buffer, int bufSize)
 	return i;
 }
 
+int SerialPort_readBulk(SerialPort self, uint8_t *buffer, int bufSize)
+{
+	if (self == NULL || buffer == NULL || bufSize <= 0) return -1;
+
+	fd_set set;
+	SOCKET s = (SOCKET)(SerialPort_getDescriptor(self).u64);
+	struct timeval tv;
+	tv.tv_sec = self->timeout/1000;
+	tv.tv_usec = (self->timeout % 1000) * 1000;
+
+	self->lastError = SERIAL_PORT_ERROR_NONE;
+
+	FD_ZERO(&set);
+	FD_SET(s, &set);
+
+	int ret = select(0, &set, NULL, NULL, &tv);
+	if (ret == -1) {
+		self->lastError = SERIAL_PORT_ERROR_UNKNOWN;
+		return -1;
+	} else if (ret == 0) {
+		return 0;
+	}
+	int rc = ShDescStream_read(self->sds, buffer, bufSize);
+	return (rc > 0)? rc : 0;
+}
+
+int SerialPort_getFrameGap(SerialPort self)
+{
+	if (self == NULL || self->baudRate <= 0) return -1;
+	if (self->frameGap > 0) return self->frameGap;
+	if (self->baudRate > 19200) return 1750; // fixed by Modbus RTU for the high rates
+	int bits = 1 + self->dataBits + ((self->parity != 'N')? 1 : 0) + self->stopBits;
+	// 3.5 characters rounded up
+	return (int)((35LL * bits * 1000000LL + 10LL * self->baudRate - 1) / (10LL * self->baudRate));
+}
+
+void SerialPort_setFrameGap(SerialPort self, int gapInUs)
+{
+	if (self == NULL) return;
+	self->frameGap = (gapInUs > 0)? gapInUs : 0;
+}
+
+int SerialPort_readFrame(SerialPort self, uint8_t *buffer, int bufSize, uint64_t *timestampInNs)
+{
+	int cnt = SerialPort_readBulk(self, buffer, bufSize);
+	if (cnt <= 0) return cnt;
+	if (timestampInNs) *timestampInNs = Hal_getMonotonicTimeInNs();
+
+	int gap = SerialPort_getFrameGap(self);
+	uint8_t scratch[256];
+	fd_set set;
+	SOCKET s = (SOCKET)(SerialPort_getDescriptor(self).u64);
+
+	while (1) {
+		struct timeval tv = { .tv_sec = gap / 1000000, .tv_usec = gap % 1000000 };
+		FD_ZERO(&set);
+		FD_SET(s, &set);
+		int ret = select(0, &set, NULL, NULL, &tv);
+		if (ret == 0) break; // silence: end of the frame
+		if (ret < 0) {
+			self->lastError = SERIAL_PORT_ERROR_UNKNOWN;
+			return -1;
+		}
+		// the overflow is discarded
+		uint8_t *dst = (cnt < bufSize)? buffer + cnt : scratch;
+		int room = (cnt < bufSize)? bufSize - cnt : (int)sizeof(scratch);
+		int rc = ShDescStream_read(self->sds, dst, room);
+		if (rc <= 0) break;
+		if (dst != scratch) cnt += rc;
+	}
+	return cnt;
+}
+
+bool SerialPort_startRxRing(SerialPort self, int size)
+{
+	// not implemented
+	(void)self;
+	(void)size;
+	return false;
+}
+
+void SerialPort_stopRxRing(SerialPort self)
+{
+	(void)self;
+}
+
+unidesc SerialPort_getRxRingDescriptor(SerialPort self)
+{
+	(void)self;
+	return Hal_getInvalidUnidesc();
+}
+
+int SerialPort_peekRxRing(SerialPort self, const uint8_t **data, uint64_t *timestampInNs)
+{
+	(void)self;
+	(void)data;
+	(void)timestampInNs;
+	return -1;
+}
+
+void SerialPort_consumeRxRing(SerialPort self, int size)
+{
+	(void)self;
+	(void)size;
+}
+
 int SerialPort_write(SerialPort self, uint8_t *buffer, int bufSize)
 {
 	if (self == NULL || buffer == NULL) return -1;
@@ -310,6 +436,69 @@ void SerialPort_setTimeout(SerialPort self, int timeout)
 	self->timeout = timeout;
 }
 
+bool SerialPort_setRs485(SerialPort self, const SerialPortRs485 *config)
+{
+	if (self == NULL || config == NULL) return false;
+	self->rs485 = config->enabled;
+	if (self->h == INVALID_HANDLE_VALUE) return true;
+	DCB serialParams = { 0 };
+	serialParams.DCBlength = sizeof(DCB);
+	if (GetCommState(self->h, &serialParams) == FALSE) return false;
+	serialParams.fRtsControl = (self->rs485)? RTS_CONTROL_TOGGLE : RTS_CONTROL_ENABLE;
+	return (SetCommState(self->h, &serialParams) != FALSE);
+}
+
+bool SerialPort_setLowLatency(SerialPort self, bool enable)
+{
+	// not supported
+	(void)self; (void)enable;
+	return false;
+}
+
+bool SerialPort_setLatencyTimer(SerialPort self, int timeInMs)
+{
+	// not supported: the timer is set by the adapter driver settings
+	(void)self; (void)timeInMs;
+	return false;
+}
+
+bool SerialPort_attachTxQueue(SerialPort self, HalPoll poll, int queueSize, void *user, SerialPortTxHandler handler)
+{
+	// not supported
+	(void)self; (void)poll; (void)queueSize; (void)user; (void)handler;
+	return false;
+}
+
+void SerialPort_detachTxQueue(SerialPort self)
+{
+	(void)self;
+}
+
+int SerialPort_writeAsync(SerialPort self, const uint8_t *buffer, int bufSize)
+{
+	(void)self; (void)buffer; (void)bufSize;
+	return -1;
+}
+
+int SerialPort_getTxPending(SerialPort self)
+{
+	(void)self;
+	return -1;
+}
+
+bool SerialPort_startCapture(SerialPort self, const char *filename)
+{
+	// not implemented
+	(void)self;
+	(void)filename;
+	return false;
+}
+
+void SerialPort_stopCapture(SerialPort self)
+{
+	(void)self;
+}
+
 SerialPortError SerialPort_getLastError(SerialPort self)
 {
 	if (self == NULL) return SERIAL_PORT_ERROR_UNKNOWN;
@@ -5,6 +5,7 @@
 #define _GNU_SOURCE
 #endif
 
+#include "hal_resolver.h"
 #include "hal_socket_dgram.h"
 #include "hal_utils.h"
 #include <arpa/inet.h>
@@ -42,12 +43,16 @@ struct sDgramSocket {
 	int fd;
 	int domain;
 	union uDgramSocketAddress remote;
+	struct sockaddr_storage remoteAddr;	// parsed remote (inet)
+	socklen_t remoteAddrLen;			// 0 - not set
 	int ifidx;
 	int protocol;
 };
 
 
-static bool prepareSocketAddress(const char *address, uint16_t port, struct sockaddr_in *sockaddr);
+HAL_INTERNAL HalResolver HalResolver_getSocketResolver(void);
+HAL_INTERNAL HalResolveState HalResolver_lookupAddress(HalResolver self, const char *host, int family, struct sockaddr_storage *sockaddr);
+static bool prepareSocketAddress(const char *address, uint16_t port, int family, struct sockaddr_storage *sockaddr, socklen_t *len);
 
 
 static inline void setSocketNonBlocking(int fd)
@@ -56,6 +61,22 @@ static inline void setSocketNonBlocking(int fd)
 	fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
+static inline bool isInetDomain(int domain)
+{
+	return (domain == AF_INET || domain == AF_INET6);
+}
+
+/* AF_INET6 sockets are dual-stack: IPv4 peers are seen as v4-mapped addresses */
+static int createInetSocket(int domain)
+{
+	int fd = socket(domain, SOCK_DGRAM, 0);
+	if (fd >= 0 && domain == AF_INET6) {
+		int optval = 0;
+		setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &optval, sizeof(optval));
+	}
+	return fd;
+}
+
 static inline int getSocketAvailableToRead(int fd)
 {
 	int val = 0;
@@ -69,15 +90,17 @@ static inline int getSocketAvailableToRead(int fd)
 DgramSocket UdpDgramSocket_createAndBind(const char *ip, uint16_t port)
 {
 	DgramSocket self;
-	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_storage addr;
+	socklen_t addrLen;
+	if (!prepareSocketAddress(ip, port, AF_UNSPEC, &addr, &addrLen)) {
+		return NULL;
+	}
+
+	int fd = createInetSocket(addr.ss_family);
 	if (fd < 0) return NULL;
 
 	if (ip || port) {
-		struct sockaddr_in addr;
-		if (!prepareSocketAddress(ip, port, &addr)) {
-			goto exit_error;
-		}
-		if (bind(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in)) < 0) {
+		if (bind(fd, (struct sockaddr*)&addr, addrLen) < 0) {
 			goto exit_error;
 		}
 	}
@@ -85,7 +108,7 @@ DgramSocket UdpDgramSocket_createAndBind(const char *ip, uint16_t port)
 	self = (DgramSocket)calloc(1, sizeof(struct sDgramSocket));
 	if (self) {
 		self->fd = fd;
-		self->domain = AF_INET;
+		self->domain = addr.ss_family;
 		self->protocol = -1;
 		setSocketNonBlocking(fd);
 		return self;
@@ -103,12 +126,18 @@ DgramSocket UdpDgramSocket_create(void)
 
 bool UdpDgramSocket_bind(DgramSocket self, const char *ip, uint16_t port)
 {
-	if (self == NULL) return false;
-	struct sockaddr_in addr;
-	if (!prepareSocketAddress(ip, port, &addr)) {
+	if (self == NULL || !isInetDomain(self->domain)) return false;
+	struct sockaddr_storage addr;
+	socklen_t addrLen;
+	// IPv4 is v4-mapped for the dual-stack IPv6 socket
+	if (!prepareSocketAddress(ip, port, self->domain, &addr, &addrLen)) {
+		return false;
+	}
+	if (addr.ss_family != self->domain) {
+		// the socket is not replaced: its options and descriptor stay valid
 		return false;
 	}
-	if (bind(self->fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in)) < 0) {
+	if (bind(self->fd, (struct sockaddr*)&addr, addrLen) < 0) {
 		return false;
 	}
 	return true;
@@ -120,6 +149,21 @@ bool UdpDgramSocket_joinGroup(DgramSocket self, const char *ip, const char *ifac
 	struct ip_mreqn imreqn;
 	struct ifreq ifr;
 	memset(&ifr, 0, sizeof(ifr));
+	if (strchr(ip, ':')) {
+		struct ipv6_mreq mreq;
+		int idx = 0;
+		if (self->domain != AF_INET6) return false;
+		if (inet_pton(AF_INET6, ip, &mreq.ipv6mr_multiaddr) != 1) return false;
+		NetwHlpr_interfaceInfo(iface, &idx, (char *)ifr.ifr_name, NULL, NULL);
+		mreq.ipv6mr_interface = idx;
+		if (setsockopt(self->fd, IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+			return false;
+		}
+		if (setsockopt(self->fd, SOL_SOCKET, SO_BINDTODEVICE, &ifr, sizeof(struct ifreq)) < 0) {
+			return false;
+		}
+		return true;
+	}
 	imreqn.imr_multiaddr.s_addr = inet_addr(ip);
 	imreqn.imr_address.s_addr = htonl(INADDR_ANY);
 	NetwHlpr_interfaceInfo(iface, &imreqn.imr_ifindex, (char *)ifr.ifr_name, NULL, NULL);
@@ -286,7 +330,7 @@ bool DgramSocket_reset(DgramSocket self)
 		close(self->fd);
 		uint16_t protocol = (self->protocol != -1)? (uint16_t)self->protocol : 0;
 		int type = (self->domain == AF_PACKET)? SOCK_RAW : SOCK_DGRAM;
-		self->fd = socket(self->domain, type, protocol);
+		self->fd = (isInetDomain(self->domain))? createInetSocket(self->domain) : socket(self->domain, type, protocol);
 		if (self->fd >= 0) {
 			if (self->domain == AF_PACKET) {
 				char iface[32];
@@ -313,10 +357,28 @@ HAL_INTERNAL void DgramSocket_close(DgramSocket self)
 	}
 }
 
+// parsed once for the following writes and filtering
+static bool parseRemote(DgramSocket self)
+{
+	socklen_t len;
+	if (self->remote.ip[0] == '\0') return false;
+	if (!prepareSocketAddress(self->remote.ip, self->remote.port, self->domain, &self->remoteAddr, &len)) {
+		return false;
+	}
+	self->remoteAddrLen = len;
+	return true;
+}
+
 void DgramSocket_setRemote(DgramSocket self, const DgramSocketAddress addr)
 {
 	if (self == NULL || addr == NULL) return;
-	memcpy(&self->remote, addr, sizeof(union uDgramSocketAddress));
+	if (addr != &self->remote) {
+		memcpy(&self->remote, addr, sizeof(union uDgramSocketAddress));
+	}
+	self->remoteAddrLen = 0;
+	if (isInetDomain(self->domain)) {
+		parseRemote(self); // a pending name is parsed again by the write
+	}
 }
 
 void DgramSocket_getRemote(DgramSocket self, DgramSocketAddress addr)
@@ -325,23 +387,11 @@ void DgramSocket_getRemote(DgramSocket self, DgramSocketAddress addr)
 	memcpy(addr, &self->remote, sizeof(union uDgramSocketAddress));
 }
 
-static int socketReadFrom(DgramSocket self, DgramSocketAddress addr, uint8_t *buf, int size, int flags)
+static int socketReadFrom(DgramSocket self, DgramSocketAddress addr, uint8_t *buf, int size, int flags, struct sockaddr_storage *source)
 {
 	struct sockaddr_storage saddr;
-	socklen_t addr_size;
+	socklen_t addr_size = sizeof(struct sockaddr_storage);
 	memset(&saddr, 0, sizeof(struct sockaddr_storage));
-	switch (self->domain) {
-		case AF_INET: {
-			addr_size = sizeof(struct sockaddr_in);
-		} break;
-		case AF_UNIX: {
-			addr_size = sizeof(struct sockaddr_un);
-		} break;
-		case AF_PACKET: {
-			addr_size = sizeof(struct sockaddr_ll);
-		} break;
-		default: break;
-	}
 	int rc = recvfrom(self->fd, buf, size, flags, (struct sockaddr *)&saddr, &addr_size);
 	if (rc > 0) {
 		if (addr) {
@@ -351,6 +401,15 @@ static int socketReadFrom(DgramSocket self, DgramSocketAddress addr, uint8_t *bu
 					Hal_ipv4BinToStr(paddr->sin_addr.s_addr, addr->ip);
 					addr->port = htons(paddr->sin_port);
 				} break;
+				case AF_INET6: {
+					struct sockaddr_in6 *paddr = (struct sockaddr_in6 *)&saddr;
+					if (IN6_IS_ADDR_V4MAPPED(&(paddr->sin6_addr))) {
+						inet_ntop(AF_INET, &(paddr->sin6_addr.s6_addr[12]), addr->ip, INET_ADDRSTRLEN);
+					} else {
+						inet_ntop(AF_INET6, &(paddr->sin6_addr), addr->ip, INET6_ADDRSTRLEN);
+					}
+					addr->port = htons(paddr->sin6_port);
+				} break;
 				case AF_UNIX: {
 					struct sockaddr_un *paddr = (struct sockaddr_un *)&saddr;
 					strcpy(addr->address, paddr->sun_path);
@@ -362,6 +421,9 @@ static int socketReadFrom(DgramSocket self, DgramSocketAddress addr, uint8_t *bu
 				default: break;
 			}
 		}
+		if (source) {
+			memcpy(source, &saddr, sizeof(struct sockaddr_storage));
+		}
 	}
 	return rc;
 }
@@ -369,7 +431,7 @@ static int socketReadFrom(DgramSocket self, DgramSocketAddress addr, uint8_t *bu
 int DgramSocket_readFrom(DgramSocket self, DgramSocketAddress addr, uint8_t *buf, int size)
 {
 	if (self == NULL || addr == NULL || buf == NULL) return -1;
-	return socketReadFrom(self, addr, buf, size, 0);
+	return socketReadFrom(self, addr, buf, size, 0, NULL);
 }
 
 int DgramSocket_writeTo(DgramSocket self, const DgramSocketAddress addr, const uint8_t *buf, int size)
@@ -379,12 +441,11 @@ int DgramSocket_writeTo(DgramSocket self, const DgramSocketAddress addr, const u
 	socklen_t addr_size = 0;
 	memset(&saddr, 0, sizeof(struct sockaddr_storage));
 	switch (self->domain) {
-		case AF_INET: {
-			struct sockaddr_in *paddr = (struct sockaddr_in *)&saddr;
-			addr_size = sizeof(struct sockaddr_in);
-			paddr->sin_addr.s_addr = inet_addr(addr->ip);
-			paddr->sin_family = AF_INET;
-			paddr->sin_port = htons(addr->port);
+		case AF_INET:
+		case AF_INET6: {
+			if (!prepareSocketAddress(addr->ip, addr->port, self->domain, &saddr, &addr_size)) {
+				return -1;
+			}
 		} break;
 		case AF_UNIX: {
 			struct sockaddr_un *paddr = (struct sockaddr_un *)&saddr;
@@ -410,58 +471,103 @@ int DgramSocket_read(DgramSocket self, uint8_t *buf, int size)
 	if (self == NULL || buf == NULL) return -1;
 	int rc = DgramSocket_readAvailable(self, true);
 	if (rc <= 0) return rc;
-	return socketReadFrom(self, NULL, buf, size, 0);
+	return socketReadFrom(self, NULL, buf, size, 0, NULL);
 }
 
 int DgramSocket_write(DgramSocket self, const uint8_t *buf, int size)
 {
 	if (self == NULL || buf == NULL) return -1;
+	if (isInetDomain(self->domain)) {
+		if (self->remoteAddrLen == 0 && !parseRemote(self)) return -1;
+		return sendto(self->fd, buf, size, 0, (const struct sockaddr *)&self->remoteAddr, self->remoteAddrLen);
+	}
 	return DgramSocket_writeTo(self, &self->remote, buf, size);
 }
 
+static bool isRemoteSource(DgramSocket self, const DgramSocketAddress source, const struct sockaddr_storage *saddr)
+{
+	switch (self->domain) {
+		case AF_INET: {
+			const struct sockaddr_in *a1 = (const struct sockaddr_in *)saddr;
+			const struct sockaddr_in *a2 = (const struct sockaddr_in *)&self->remoteAddr;
+			return (self->remoteAddrLen != 0 && a1->sin_port == a2->sin_port &&
+					a1->sin_addr.s_addr == a2->sin_addr.s_addr);
+		}
+		case AF_INET6: {
+			const struct sockaddr_in6 *a1 = (const struct sockaddr_in6 *)saddr;
+			const struct sockaddr_in6 *a2 = (const struct sockaddr_in6 *)&self->remoteAddr;
+			return (self->remoteAddrLen != 0 && a1->sin6_port == a2->sin6_port &&
+					IN6_ARE_ADDR_EQUAL(&(a1->sin6_addr), &(a2->sin6_addr)));
+		}
+		case AF_UNIX:
+			return (strcmp(source->address, self->remote.address) == 0);
+		case AF_PACKET:
+			return (memcmp(source->mac, self->remote.mac, ETH_ALEN) == 0);
+		default: break;
+	}
+	return false;
+}
+
 int DgramSocket_readAvailable(DgramSocket self, bool fromRemote)
 {
 	if (self == NULL) return -1;
 
 	uint8_t buf[1];
 	union uDgramSocketAddress source;
+	struct sockaddr_storage saddr;
 	int ret, rc;
 	while (1) {
 		ret = getSocketAvailableToRead(self->fd);
 		if (ret <= 0) return ret;
 		if (!fromRemote) return ret;
 		//
-		rc = socketReadFrom(self, &source, buf, 1, MSG_PEEK);
+		rc = socketReadFrom(self, &source, buf, 1, MSG_PEEK, &saddr);
 		if (rc > 0) {
-			switch (self->domain) {
-				case AF_INET: {
-					if (source.port == self->remote.port && strcmp(source.ip, self->remote.ip) == 0) {
-						return ret;
-					}
-				} break;
-				case AF_UNIX: {
-					if (strcmp(source.address, self->remote.address) == 0) {
-						return ret;
-					}
-				} break;
-				case AF_PACKET: {
-					if (memcmp(source.mac, self->remote.mac, ETH_ALEN) == 0) {
-						return ret;
-					}
-				} break;
-				default: break;
+			if (isRemoteSource(self, &source, &saddr)) {
+				return ret;
 			}
-			socketReadFrom(self, &source, buf, 1, 0); // flush
+			socketReadFrom(self, &source, buf, 1, 0, NULL); // flush
 		} else {
 			return -1;
 		}
 	}
 }
 
+static int socketReceiveFrom(DgramSocket self, DgramSocketAddress addr, uint8_t *buf, int size, int *fullSize, struct sockaddr_storage *source)
+{
+	int rc = socketReadFrom(self, addr, buf, size, MSG_TRUNC | MSG_DONTWAIT, source);
+	if (rc < 0) {
+		return (errno == EAGAIN || errno == EWOULDBLOCK)? 0 : -1;
+	}
+	if (fullSize) *fullSize = rc;
+	return (rc > size)? size : rc;
+}
+
+int DgramSocket_receiveFrom(DgramSocket self, DgramSocketAddress addr, uint8_t *buf, int size, int *fullSize)
+{
+	if (fullSize) *fullSize = 0;
+	if (self == NULL || buf == NULL) return -1;
+	return socketReceiveFrom(self, addr, buf, size, fullSize, NULL);
+}
+
+int DgramSocket_receive(DgramSocket self, uint8_t *buf, int size, int *fullSize)
+{
+	if (fullSize) *fullSize = 0;
+	if (self == NULL || buf == NULL) return -1;
+	union uDgramSocketAddress source;
+	struct sockaddr_storage saddr;
+	while (1) {
+		int rc = socketReceiveFrom(self, &source, buf, size, fullSize, &saddr);
+		if (rc <= 0) return rc;
+		if (isRemoteSource(self, &source, &saddr)) return rc;
+		// not from remote: drop
+	}
+}
+
 int DgramSocket_peek(DgramSocket self, DgramSocketAddress addr, uint8_t *buf, int size)
 {
 	if (self == NULL || addr == NULL || buf == NULL) return -1;
-	return socketReadFrom(self, addr, buf, size, MSG_PEEK);
+	return socketReadFrom(self, addr, buf, size, MSG_PEEK, NULL);
 }
 
 void DgramSocket_destroy(DgramSocket self)
@@ -482,35 +588,108 @@ unidesc DgramSocket_getDescriptor(DgramSocket self)
 }
 
 
-static bool prepareSocketAddress(const char *address, uint16_t port, struct sockaddr_in *sockaddr)
+/*
+ * Numeric addresses are parsed without name resolution. family:
+ *  AF_UNSPEC - any result; AF_INET - IPv4 only;
+ *  AF_INET6 - IPv6 or IPv4 as v4-mapped address (for the dual-stack socket)
+ */
+static bool prepareSocketAddress(const char *address, uint16_t port, int family, struct sockaddr_storage *sockaddr, socklen_t *len)
 {
-	bool retVal = true;
+	struct sockaddr_in *sin = (struct sockaddr_in *)sockaddr;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)sockaddr;
+	struct in_addr v4;
 
-	memset((char *)sockaddr, 0, sizeof(struct sockaddr_in));
+	memset((char *) sockaddr, 0, sizeof(struct sockaddr_storage));
 
-	if (address != NULL) {
+	if (address == NULL) {
+		if (family == AF_INET6) {
+			sin6->sin6_addr = in6addr_any;
+			goto set_inet6;
+		}
+		v4.s_addr = htonl(INADDR_ANY);
+		goto set_inet;
+	}
+
+	if (inet_pton(AF_INET, address, &v4) == 1) {
+		goto set_inet;
+	}
+	if (inet_pton(AF_INET6, address, &(sin6->sin6_addr)) == 1) {
+		goto set_inet6;
+	}
+
+	HalResolver resolver = HalResolver_getSocketResolver();
+	if (resolver) {
+		// no blocking: the name is taken from the cache
+		switch (HalResolver_lookupAddress(resolver, address, family, sockaddr)) {
+			case HAL_RESOLVE_DONE:
+				if (sockaddr->ss_family == AF_INET) {
+					v4 = sin->sin_addr;
+					goto set_inet;
+				}
+				goto set_inet6;
+			case HAL_RESOLVE_PENDING:
+				errno = EWOULDBLOCK;
+				return false;
+			default:
+				return false;
+		}
+	}
+
+	{
 		struct addrinfo addressHints;
 		struct addrinfo *lookupResult;
 		int result;
 
 		memset(&addressHints, 0, sizeof(struct addrinfo));
-		addressHints.ai_family = AF_INET;
+		addressHints.ai_family = (family == AF_INET)? AF_INET : AF_UNSPEC;
+		addressHints.ai_socktype = SOCK_DGRAM;
 		result = getaddrinfo(address, NULL, &addressHints, &lookupResult);
 
 		if (result != 0) {
 			return false;
 		}
 
-		memcpy(sockaddr, lookupResult->ai_addr, sizeof(struct sockaddr_in));
+		int found = AF_UNSPEC;
+		for (struct addrinfo *ai = lookupResult; ai; ai = ai->ai_next) {
+			if (ai->ai_family == AF_INET) {
+				v4 = ((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+				found = AF_INET;
+				break;
+			}
+			if (ai->ai_family == AF_INET6 && family != AF_INET) {
+				memcpy(sin6, ai->ai_addr, sizeof(struct sockaddr_in6)); // keeps the scope id
+				found = AF_INET6;
+				break;
+			}
+		}
 		freeaddrinfo(lookupResult);
-	} else {
-		sockaddr->sin_addr.s_addr = htonl(INADDR_ANY);
+
+		if (found == AF_INET) goto set_inet;
+		if (found == AF_INET6) goto set_inet6;
+		return false;
 	}
 
-	sockaddr->sin_family = AF_INET;
-	sockaddr->sin_port = htons(port);
+set_inet:
+	if (family == AF_INET6) {
+		sin6->sin6_addr.s6_addr[10] = 0xff;
+		sin6->sin6_addr.s6_addr[11] = 0xff;
+		memcpy(&(sin6->sin6_addr.s6_addr[12]), &v4, sizeof(v4));
+		goto set_inet6;
+	}
+	sin->sin_family = AF_INET;
+	sin->sin_addr = v4;
+	sin->sin_port = htons(port);
+	*len = sizeof(struct sockaddr_in);
+	return true;
 
-	return retVal;
+set_inet6:
+	if (family == AF_INET) {
+		return false;
+	}
+	sin6->sin6_family = AF_INET6;
+	sin6->sin6_port = htons(port);
+	*len = sizeof(struct sockaddr_in6);
+	return true;
 }
 
 
@@ -1,6 +1,7 @@
 
 #if defined(_WIN32) || defined(_WIN64)
 
+#include "hal_resolver.h"
 #include "hal_socket_dgram.h"
 #include "hal_syshelper.h"
 #include "hal_utils.h"
@@ -27,6 +28,8 @@ struct sDgramSocket {
 };
 
 
+HAL_INTERNAL HalResolver HalResolver_getSocketResolver(void);
+HAL_INTERNAL HalResolveState HalResolver_lookupAddress(HalResolver self, const char *host, int family, struct sockaddr_storage *sockaddr);
 static bool prepareSocketAddress(const char *address, uint16_t port, struct sockaddr_in *sockaddr);
 
 HAL_INTERNAL DgramSocket EtherDgramSocket_create0(const char *iface, uint16_t ethTypeFilter, int domain);
@@ -358,6 +361,22 @@ int DgramSocket_readAvailable(DgramSocket self, bool fromRemote)
 	return DgramSocket_readAvailable0(self, fromRemote);
 }
 
+int DgramSocket_receiveFrom(DgramSocket self, DgramSocketAddress addr, uint8_t *buf, int size, int *fullSize)
+{
+	// no MSG_TRUNC: the real size is unknown
+	union uDgramSocketAddress source;
+	int rc = DgramSocket_readFrom(self, (addr)? addr : &source, buf, size);
+	if (fullSize) *fullSize = (rc > 0)? rc : 0;
+	return rc;
+}
+
+int DgramSocket_receive(DgramSocket self, uint8_t *buf, int size, int *fullSize)
+{
+	int rc = DgramSocket_read(self, buf, size);
+	if (fullSize) *fullSize = (rc > 0)? rc : 0;
+	return rc;
+}
+
 int DgramSocket_peek(DgramSocket self, DgramSocketAddress addr, uint8_t *buf, int size)
 {
 	if (self == NULL || addr == NULL || buf == NULL) return -1;
@@ -399,6 +418,23 @@ static bool prepareSocketAddress(const char *address, uint16_t port, struct sock
 
 	memset((char *)sockaddr, 0, sizeof(struct sockaddr_in));
 
+	HalResolver resolver = HalResolver_getSocketResolver();
+	if (address != NULL && resolver != NULL && inet_pton(AF_INET, address, &(sockaddr->sin_addr)) != 1) {
+		// no blocking: the name is taken from the cache
+		struct sockaddr_storage resolved;
+		switch (HalResolver_lookupAddress(resolver, address, AF_INET, &resolved)) {
+			case HAL_RESOLVE_DONE:
+				memcpy(sockaddr, &resolved, sizeof(struct sockaddr_in));
+				sockaddr->sin_port = htons(port);
+				return true;
+			case HAL_RESOLVE_PENDING:
+				WSASetLastError(WSAEWOULDBLOCK);
+				return false;
+			default:
+				return false;
+		}
+	}
+
 	if (address != NULL) {
 		struct addrinfo addressHints;
 		struct addrinfo *lookupResult;
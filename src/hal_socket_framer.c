@@ -0,0 +1,289 @@
+#ifdef __linux__
+# ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+# endif
+# include <sys/mman.h>
+# include <unistd.h>
+# define FRAMER_MIRROR_MAP
+#endif
+
+#include "hal_socket_framer.h"
+
+
+/*
+ * The ring buffer is followed by its mirror, so any [pos, pos+size) region of
+ * the ring is contiguous in memory. On linux the mirror is the second mapping of
+ * the same memfd pages. Otherwise (or if the mapping failed) the written bytes
+ * are copied to the mirror: only wrapped data and the head of the ring that
+ * can be reached by a message view.
+ */
+struct sStreamFramer {
+	StreamFramerConfig cfg;
+	uint8_t *base;
+	uint32_t size;		// ring size
+	uint32_t limit;		// maximum frame size (header + payload + delimiter)
+	uint32_t maxPayload;
+	bool mirrored;		// memory is mapped twice
+	bool broken;
+	uint64_t head;		// start of the unreleased data
+	uint64_t next;		// start of the unparsed data
+	uint64_t tail;		// end of the data
+	uint64_t scan;		// delimiter search position
+};
+
+
+#ifdef FRAMER_MIRROR_MAP
+static bool allocMirrored(StreamFramer self)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	if (page <= 0) return false;
+	uint32_t size = (uint32_t)(((self->size + page - 1) / page) * page);
+
+	int fd = memfd_create("halframer", MFD_CLOEXEC);
+	if (fd < 0) return false;
+	if (ftruncate(fd, size) < 0) goto exit_fd;
+
+	uint8_t *addr = (uint8_t *)mmap(NULL, 2*(size_t)size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) goto exit_fd;
+	if (mmap(addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) goto exit_map;
+	if (mmap(addr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) goto exit_map;
+
+	close(fd);
+	self->base = addr;
+	self->size = size;
+	self->mirrored = true;
+	return true;
+
+exit_map:
+	munmap(addr, 2*(size_t)size);
+exit_fd:
+	close(fd);
+	return false;
+}
+#endif
+
+static void mirrorWritten(StreamFramer self, uint32_t off, uint32_t n)
+{
+	if (self->mirrored) return;
+	uint32_t first = (n < self->size - off)? n : self->size - off;
+	if (off < self->limit) {
+		uint32_t cnt = self->limit - off;
+		if (cnt > first) cnt = first;
+		memcpy(self->base + self->size + off, self->base + off, cnt);
+	}
+	if (n > first) {
+		memcpy(self->base, self->base + self->size, n - first);
+	}
+}
+
+static uint32_t headerMaxSize(const StreamFramerConfig *cfg)
+{
+	switch (cfg->type) {
+		case STREAM_FRAMER_FIXED: return cfg->lengthSize;
+		case STREAM_FRAMER_VARINT: return 5;
+		case STREAM_FRAMER_DELIMITER: return cfg->delimiterSize;
+	}
+	return 0;
+}
+
+
+StreamFramer StreamFramer_create(const StreamFramerConfig *config, uint32_t bufferSize)
+{
+	if (config == NULL || bufferSize == 0) return NULL;
+	switch (config->type) {
+		case STREAM_FRAMER_FIXED:
+			if (config->lengthSize != 1 && config->lengthSize != 2 && config->lengthSize != 4) return NULL;
+			break;
+		case STREAM_FRAMER_VARINT:
+			break;
+		case STREAM_FRAMER_DELIMITER:
+			if (config->delimiterSize == 0 || config->delimiterSize > sizeof(config->delimiter)) return NULL;
+			break;
+		default: return NULL;
+	}
+
+	StreamFramer self = (StreamFramer)calloc(1, sizeof(struct sStreamFramer));
+	if (self == NULL) return NULL;
+	self->cfg = *config;
+	self->size = bufferSize;
+
+	#ifdef FRAMER_MIRROR_MAP
+	allocMirrored(self);
+	#endif
+	if (!self->mirrored) {
+		self->base = (uint8_t *)malloc(2*(size_t)self->size);
+		if (self->base == NULL) {
+			free(self);
+			return NULL;
+		}
+	}
+
+	uint32_t hdr = headerMaxSize(config);
+	if (hdr >= self->size) {
+		StreamFramer_destroy(self);
+		return NULL;
+	}
+	self->maxPayload = self->size - hdr;
+	if (config->maxMessageSize && config->maxMessageSize < self->maxPayload) {
+		self->maxPayload = config->maxMessageSize;
+	}
+	self->limit = self->maxPayload + hdr;
+	return self;
+}
+
+uint8_t *StreamFramer_getWriteBuffer(StreamFramer self, uint32_t *size)
+{
+	if (self == NULL || size == NULL) return NULL;
+	*size = self->size - (uint32_t)(self->tail - self->head);
+	return self->base + (self->tail % self->size);
+}
+
+void StreamFramer_commit(StreamFramer self, uint32_t size)
+{
+	if (self == NULL || size == 0) return;
+	uint32_t free = self->size - (uint32_t)(self->tail - self->head);
+	if (size > free) size = free;
+	mirrorWritten(self, (uint32_t)(self->tail % self->size), size);
+	self->tail += size;
+}
+
+int StreamFramer_receive(StreamFramer self, ClientSocket socket)
+{
+	if (self == NULL || socket == NULL) return -1;
+	uint32_t free;
+	uint8_t *buf = StreamFramer_getWriteBuffer(self, &free);
+	if (free == 0) return 0;
+	int rc = ClientSocket_receive(socket, buf, (int)free, NULL); // -1 on EOF
+	if (rc > 0) {
+		StreamFramer_commit(self, (uint32_t)rc);
+	}
+	return rc;
+}
+
+static bool parseFixed(StreamFramer self, const uint8_t *p, uint32_t avail, uint32_t *hdr, int64_t *len)
+{
+	uint8_t ls = self->cfg.lengthSize;
+	if (avail < ls) return false;
+	uint32_t v = 0;
+	for (int i = 0; i < ls; ++i) {
+		int idx = (self->cfg.bigEndian)? i : (ls - 1 - i);
+		v = (v << 8) | p[idx];
+	}
+	*hdr = ls;
+	*len = (int64_t)v + self->cfg.lengthAdjust;
+	return true;
+}
+
+static bool parseVarint(StreamFramer self, const uint8_t *p, uint32_t avail, uint32_t *hdr, int64_t *len)
+{
+	uint32_t v = 0;
+	for (uint32_t i = 0; i < 5; ++i) {
+		if (i >= avail) return false;
+		if (i == 4 && p[i] > 0x0F) break; // bits above 31
+		v |= (uint32_t)(p[i] & 0x7F) << (7*i);
+		if ((p[i] & 0x80) == 0) {
+			*hdr = i + 1;
+			*len = v;
+			return true;
+		}
+	}
+	self->broken = true; // longer than 32 bit
+	return false;
+}
+
+static bool findDelimiter(StreamFramer self, const uint8_t *p, uint32_t avail, uint32_t *pos)
+{
+	const uint8_t *d = self->cfg.delimiter;
+	uint32_t ds = self->cfg.delimiterSize;
+	uint32_t i = (uint32_t)(self->scan - self->next);
+	while (i + ds <= avail) {
+		const uint8_t *f = (const uint8_t *)memchr(p + i, d[0], avail - i - ds + 1);
+		if (f == NULL) break;
+		i = (uint32_t)(f - p);
+		if (memcmp(f, d, ds) == 0) {
+			*pos = i;
+			return true;
+		}
+		i++;
+	}
+	// continue from here when more data comes
+	self->scan = self->next + ((avail >= ds)? avail - ds + 1 : 0);
+	return false;
+}
+
+bool StreamFramer_next(StreamFramer self, const uint8_t **data, uint32_t *size)
+{
+	if (self == NULL || data == NULL || size == NULL) return false;
+
+	self->head = self->next; // release the previous message
+	if (self->broken) return false;
+
+	uint32_t avail = (uint32_t)(self->tail - self->next);
+	const uint8_t *p = self->base + (self->next % self->size);
+	uint32_t hdr = 0;
+	int64_t len = 0;
+
+	switch (self->cfg.type) {
+		case STREAM_FRAMER_FIXED:
+			if (!parseFixed(self, p, avail, &hdr, &len)) return false;
+			break;
+		case STREAM_FRAMER_VARINT:
+			if (!parseVarint(self, p, avail, &hdr, &len)) return false;
+			break;
+		case STREAM_FRAMER_DELIMITER: {
+			uint32_t pos;
+			if (!findDelimiter(self, p, avail, &pos)) {
+				if (avail >= self->limit) self->broken = true;
+				return false;
+			}
+			if (pos > self->maxPayload) {
+				self->broken = true;
+				return false;
+			}
+			*data = p;
+			*size = pos;
+			self->next += pos + self->cfg.delimiterSize;
+			self->scan = self->next;
+			return true;
+		}
+	}
+
+	if (len < 0 || len > self->maxPayload) {
+		self->broken = true;
+		return false;
+	}
+	if (avail < hdr + (uint32_t)len) return false;
+
+	*data = p + hdr;
+	*size = (uint32_t)len;
+	self->next += hdr + (uint32_t)len;
+	self->scan = self->next;
+	return true;
+}
+
+bool StreamFramer_isBroken(StreamFramer self)
+{
+	if (self == NULL) return true;
+	return self->broken;
+}
+
+void StreamFramer_reset(StreamFramer self)
+{
+	if (self == NULL) return;
+	self->head = self->next = self->scan = self->tail = 0;
+	self->broken = false;
+}
+
+void StreamFramer_destroy(StreamFramer self)
+{
+	if (self == NULL) return;
+	#ifdef FRAMER_MIRROR_MAP
+	if (self->mirrored) {
+		munmap(self->base, 2*(size_t)self->size);
+	} else
+	#endif
+	{
+		free(self->base);
+	}
+	free(self);
+}
@@ -0,0 +1,258 @@
+#include "hal_socket_pool.h"
+#include "hal_poll.h"
+#include "hal_thread.h"
+
+
+typedef struct sPoolDestination PoolDestination;
+
+typedef struct sPoolEntry {
+	ClientSocket socket;
+	bool idle;
+	int index;					// in the destination entries
+	PoolDestination *destination;
+	struct sPoolEntry *next;	// in the socket hash chain
+} PoolEntry;
+
+struct sPoolDestination {
+	union uClientSocketAddress address;
+	int index;					// in the pool destinations
+	int size;
+	PoolEntry **entries;
+};
+
+#define POOL_DESTINATIONS_STEP 8
+#define POOL_HASH_SIZE 64		// power of 2
+
+struct sClientSocketPool {
+	Mutex mu;
+	int maxPerAddress;
+	int size;
+	int maxSize;
+	PoolDestination **destinations;
+	PoolEntry *sockets[POOL_HASH_SIZE];	// socket -> entry for the release
+};
+
+
+static inline bool addressIsEqual(const ClientSocketAddress a1, const ClientSocketAddress a2)
+{
+	return (a1->port == a2->port && strncmp(a1->ip, a2->ip, sizeof(a1->ip)) == 0);
+}
+
+static inline PoolEntry **socketSlot(ClientSocketPool self, ClientSocket socket)
+{
+	uintptr_t h = (uintptr_t)socket;
+	h ^= h >> 9; // the allocations are aligned
+	return &self->sockets[(h >> 4) & (POOL_HASH_SIZE - 1)];
+}
+
+static PoolDestination *findDestination(ClientSocketPool self, const ClientSocketAddress address)
+{
+	for (int i = 0; i < self->size; ++i) {
+		if (addressIsEqual(&self->destinations[i]->address, address)) {
+			return self->destinations[i];
+		}
+	}
+	return NULL;
+}
+
+static PoolDestination *addDestination(ClientSocketPool self, const ClientSocketAddress address)
+{
+	if (self->size >= self->maxSize) {
+		int maxSize = self->maxSize + POOL_DESTINATIONS_STEP;
+		PoolDestination **d = (PoolDestination **)realloc(self->destinations, maxSize * sizeof(PoolDestination *));
+		if (d == NULL) return NULL;
+		self->destinations = d;
+		self->maxSize = maxSize;
+	}
+	PoolDestination *dst = (PoolDestination *)calloc(1, sizeof(PoolDestination));
+	if (dst == NULL) return NULL;
+	dst->entries = (PoolEntry **)calloc(self->maxPerAddress, sizeof(PoolEntry *));
+	if (dst->entries == NULL) {
+		free(dst);
+		return NULL;
+	}
+	strncpy(dst->address.ip, address->ip, sizeof(dst->address.ip)-1);
+	dst->address.port = address->port;
+	dst->index = self->size;
+	self->destinations[self->size++] = dst;
+	return dst;
+}
+
+/* the destinations without connections are freed: the pool does not fill up */
+static void releaseDestination(ClientSocketPool self, PoolDestination *dst)
+{
+	if (dst->size > 0) return;
+	self->size--;
+	self->destinations[dst->index] = self->destinations[self->size];
+	self->destinations[dst->index]->index = dst->index;
+	free(dst->entries);
+	free(dst);
+}
+
+static bool addEntry(ClientSocketPool self, PoolDestination *dst, ClientSocket socket)
+{
+	PoolEntry *e = (PoolEntry *)calloc(1, sizeof(PoolEntry));
+	if (e == NULL) return false;
+	e->socket = socket;
+	e->destination = dst;
+	e->index = dst->size;
+	dst->entries[dst->size++] = e;
+	PoolEntry **slot = socketSlot(self, socket);
+	e->next = *slot;
+	*slot = e;
+	return true;
+}
+
+static PoolEntry *findEntry(ClientSocketPool self, ClientSocket socket)
+{
+	PoolEntry *e = *socketSlot(self, socket);
+	while (e && e->socket != socket) {
+		e = e->next;
+	}
+	return e;
+}
+
+static void removeEntry(ClientSocketPool self, PoolEntry *e)
+{
+	PoolEntry **pp = socketSlot(self, e->socket);
+	while (*pp != e) {
+		pp = &((*pp)->next);
+	}
+	*pp = e->next;
+	PoolDestination *dst = e->destination;
+	dst->size--;
+	dst->entries[e->index] = dst->entries[dst->size];
+	dst->entries[e->index]->index = e->index;
+	dst->entries[dst->size] = NULL;
+	free(e);
+}
+
+static bool socketIsAlive(ClientSocket socket)
+{
+	int revents = 0;
+	// idle connection must be silent: input means eof or unexpected data
+	int rc = Hal_pollSingle(ClientSocket_getDescriptor(socket), HAL_POLLIN, &revents, HAL_POLL_NOWAIT);
+	if (rc < 0) return false;
+	return (rc == 0 || revents == 0);
+}
+
+
+ClientSocketPool ClientSocketPool_create(int maxPerAddress)
+{
+	if (maxPerAddress <= 0) return NULL;
+	ClientSocketPool self = (ClientSocketPool)calloc(1, sizeof(struct sClientSocketPool));
+	if (self) {
+		self->mu = HalMutex_create();
+		if (!self->mu) {
+			free(self);
+			return NULL;
+		}
+		self->maxPerAddress = maxPerAddress;
+	}
+	return self;
+}
+
+ClientSocket ClientSocketPool_get(ClientSocketPool self, const ClientSocketAddress address)
+{
+	if (self == NULL || address == NULL) return NULL;
+
+	ClientSocket ret = NULL;
+
+	HalMutex_lock(self->mu);
+	PoolDestination *dst = findDestination(self, address);
+	if (dst == NULL) {
+		dst = addDestination(self, address);
+		if (dst == NULL) goto exit;
+	}
+
+	// warm connection
+	for (int i = 0; i < dst->size; ) {
+		PoolEntry *e = dst->entries[i];
+		if (!e->idle) { ++i; continue; }
+		if (socketIsAlive(e->socket)) {
+			e->idle = false;
+			ret = e->socket;
+			goto exit;
+		}
+		ClientSocket_destroy(e->socket);
+		removeEntry(self, e);
+	}
+
+	// new connection
+	if (dst->size < self->maxPerAddress) {
+		ClientSocket socket = TcpClientSocket_create();
+		if (socket == NULL) goto exit;
+		if (ClientSocket_connectAsync(socket, address) == false || !addEntry(self, dst, socket)) {
+			ClientSocket_destroy(socket);
+			goto exit;
+		}
+		ret = socket;
+	}
+
+exit:
+	if (dst) releaseDestination(self, dst);
+	HalMutex_unlock(self->mu);
+	return ret;
+}
+
+void ClientSocketPool_release(ClientSocketPool self, ClientSocket socket, bool reuse)
+{
+	if (self == NULL || socket == NULL) return;
+	HalMutex_lock(self->mu);
+	PoolEntry *e = findEntry(self, socket);
+	if (e) {
+		if (reuse) {
+			e->idle = true;
+		} else {
+			PoolDestination *dst = e->destination;
+			ClientSocket_destroy(socket);
+			removeEntry(self, e);
+			releaseDestination(self, dst);
+		}
+	}
+	HalMutex_unlock(self->mu);
+}
+
+int ClientSocketPool_getNumber(ClientSocketPool self, const ClientSocketAddress address)
+{
+	if (self == NULL || address == NULL) return 0;
+	HalMutex_lock(self->mu);
+	PoolDestination *dst = findDestination(self, address);
+	int ret = (dst)? dst->size : 0;
+	HalMutex_unlock(self->mu);
+	return ret;
+}
+
+int ClientSocketPool_getIdleNumber(ClientSocketPool self, const ClientSocketAddress address)
+{
+	if (self == NULL || address == NULL) return 0;
+	int ret = 0;
+	HalMutex_lock(self->mu);
+	PoolDestination *dst = findDestination(self, address);
+	if (dst) {
+		for (int i = 0; i < dst->size; ++i) {
+			if (dst->entries[i]->idle) ret++;
+		}
+	}
+	HalMutex_unlock(self->mu);
+	return ret;
+}
+
+void ClientSocketPool_destroy(ClientSocketPool self)
+{
+	if (self == NULL) return;
+	for (int i = 0; i < self->size; ++i) {
+		PoolDestination *dst = self->destinations[i];
+		for (int j = 0; j < dst->size; ++j) {
+			if (dst->entries[j]->idle) {
+				ClientSocket_destroy(dst->entries[j]->socket);
+			}
+			free(dst->entries[j]);
+		}
+		free(dst->entries);
+		free(dst);
+	}
+	free(self->destinations);
+	HalMutex_destroy(self->mu);
+	free(self);
+}
@@ -0,0 +1,334 @@
+#ifdef __linux__
+# ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+# endif
+# include <errno.h>
+# include <poll.h>
+# include <sys/eventfd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#include "hal_socket_shm.h"
+
+
+#ifdef __linux__
+
+/*
+ * Shared memory layout: header, ring 0 data, ring 1 data.
+ * Ring 0 transfers messages from the creator to the opener, ring 1 - back.
+ * Each message record is { uint32_t size; uint8_t data[size]; } aligned to 8 bytes.
+ * The record that does not fit to the end of the ring is preceded by the pad
+ * marker and is written from the ring start.
+ */
+
+#define SHM_MAGIC			0x4D48534C // "LSHM"
+#define SHM_CACHE_LINE		64
+#define SHM_REC_ALIGN		8
+#define SHM_REC_PAD			0xFFFFFFFFu
+#define SHM_RING_MIN_SIZE	1024
+#define SHM_RING_MAX_SIZE	0x40000000u
+
+struct sShmRing {
+	uint64_t tail;		// written by producer
+	uint8_t pad0[SHM_CACHE_LINE - sizeof(uint64_t)];
+	uint64_t head;		// written by consumer
+	uint8_t pad1[SHM_CACHE_LINE - sizeof(uint64_t)];
+};
+
+struct sShmHeader {
+	uint32_t magic;
+	uint32_t ringSize;
+	uint32_t closed;
+	uint8_t pad[SHM_CACHE_LINE - 3*sizeof(uint32_t)];
+	struct sShmRing ring[2];
+};
+
+struct sShmSocket {
+	struct sShmHeader *hdr;
+	size_t mapSize;
+	uint32_t ringSize;
+	struct sShmRing *tx;
+	struct sShmRing *rx;
+	uint8_t *txData;
+	uint8_t *rxData;
+	int txEvent;		// doorbell of the peer
+	int rxEvent;		// own doorbell
+	bool broken;		// the peer corrupted the receive ring
+};
+
+
+static inline uint32_t recordSize(uint32_t size)
+{
+	return (uint32_t)((sizeof(uint32_t) + size + SHM_REC_ALIGN - 1) & ~(SHM_REC_ALIGN - 1));
+}
+
+static ShmSocket attach(int memfd, uint32_t ringSize, int ev0, int ev1, bool creator)
+{
+	ShmSocket self = (ShmSocket)calloc(1, sizeof(struct sShmSocket));
+	if (self == NULL) return NULL;
+	self->mapSize = sizeof(struct sShmHeader) + 2*(size_t)ringSize;
+	void *addr = mmap(NULL, self->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+	if (addr == MAP_FAILED) {
+		free(self);
+		return NULL;
+	}
+	self->hdr = (struct sShmHeader *)addr;
+	self->ringSize = ringSize;
+	uint8_t *data = (uint8_t *)addr + sizeof(struct sShmHeader);
+	int own = (creator)? 1 : 0;
+	self->rx = &(self->hdr->ring[own]);
+	self->tx = &(self->hdr->ring[own ^ 1]);
+	self->rxData = data + own * (size_t)ringSize;
+	self->txData = data + (own ^ 1) * (size_t)ringSize;
+	self->rxEvent = (creator)? ev1 : ev0;
+	self->txEvent = (creator)? ev0 : ev1;
+	return self;
+}
+
+ShmSocket ShmSocket_create(ClientSocket channel, uint32_t ringSize)
+{
+	if (channel == NULL || ringSize > SHM_RING_MAX_SIZE) return NULL;
+	uint32_t size = SHM_RING_MIN_SIZE;
+	while (size < ringSize) size <<= 1;
+
+	int fds[3] = { -1, -1, -1 };
+	ShmSocket self = NULL;
+
+	fds[0] = memfd_create("halshm", MFD_CLOEXEC);
+	if (fds[0] < 0) goto exit_error;
+	if (ftruncate(fds[0], sizeof(struct sShmHeader) + 2*(off_t)size) < 0) goto exit_error;
+	fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	fds[2] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fds[1] < 0 || fds[2] < 0) goto exit_error;
+
+	self = attach(fds[0], size, fds[1], fds[2], true);
+	if (self == NULL) goto exit_error;
+	self->hdr->ringSize = size;
+	self->hdr->magic = SHM_MAGIC;
+
+	unidesc descs[3];
+	for (int i = 0; i < 3; ++i) {
+		descs[i].i32 = fds[i];
+	}
+	if (ClientSocket_sendDescriptors(channel, descs, 3, (const uint8_t *)&size, sizeof(size)) != sizeof(size)) {
+		munmap(self->hdr, self->mapSize);
+		free(self);
+		goto exit_error;
+	}
+	close(fds[0]);
+	return self;
+
+exit_error:
+	for (int i = 0; i < 3; ++i) {
+		if (fds[i] >= 0) close(fds[i]);
+	}
+	return NULL;
+}
+
+ShmSocket ShmSocket_open(ClientSocket channel, uint32_t timeoutInMs)
+{
+	if (channel == NULL) return NULL;
+	int fd = ClientSocket_getDescriptor(channel).i32;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+	if (poll(&pfd, 1, (int)timeoutInMs) != 1) return NULL;
+
+	int fds[3] = { -1, -1, -1 };
+	unidesc descs[3];
+	int count = 3;
+	uint32_t size = 0;
+	ShmSocket self = NULL;
+	struct stat st;
+
+	int rc = ClientSocket_recvDescriptors(channel, descs, &count, (uint8_t *)&size, sizeof(size));
+	for (int i = 0; i < count; ++i) {
+		fds[i] = descs[i].i32;
+	}
+	if (rc != sizeof(size) || count != 3) goto exit_error;
+	if (size < SHM_RING_MIN_SIZE || size > SHM_RING_MAX_SIZE || (size & (size - 1))) goto exit_error;
+	if (fstat(fds[0], &st) < 0 || (size_t)st.st_size != sizeof(struct sShmHeader) + 2*(size_t)size) goto exit_error;
+
+	self = attach(fds[0], size, fds[1], fds[2], false);
+	if (self == NULL) goto exit_error;
+	if (self->hdr->magic != SHM_MAGIC || self->hdr->ringSize != size) {
+		munmap(self->hdr, self->mapSize);
+		free(self);
+		goto exit_error;
+	}
+	close(fds[0]);
+	return self;
+
+exit_error:
+	for (int i = 0; i < 3; ++i) {
+		if (fds[i] >= 0) close(fds[i]);
+	}
+	return NULL;
+}
+
+int ShmSocket_write(ShmSocket self, const uint8_t *buf, int size)
+{
+	if (self == NULL || buf == NULL || size <= 0) return -1;
+	if ((uint32_t)size > self->ringSize / 4) return -1;
+	if (__atomic_load_n(&self->hdr->closed, __ATOMIC_ACQUIRE)) return -1;
+
+	uint32_t rec = recordSize((uint32_t)size);
+	uint64_t tail = self->tx->tail; // own
+	uint64_t head = __atomic_load_n(&self->tx->head, __ATOMIC_ACQUIRE);
+	uint32_t off = (uint32_t)(tail & (self->ringSize - 1));
+	uint32_t skip = (off + rec > self->ringSize)? self->ringSize - off : 0;
+	if (tail + skip + rec - head > self->ringSize) return 0;
+
+	uint64_t pos = tail;
+	if (skip) {
+		*((uint32_t *)(self->txData + off)) = SHM_REC_PAD;
+		pos += skip;
+		off = 0;
+	}
+	*((uint32_t *)(self->txData + off)) = (uint32_t)size;
+	memcpy(self->txData + off + sizeof(uint32_t), buf, size);
+	__atomic_store_n(&self->tx->tail, pos + rec, __ATOMIC_SEQ_CST);
+
+	// the consumer may sleep only if it has seen the empty ring
+	if (__atomic_load_n(&self->tx->head, __ATOMIC_SEQ_CST) == tail) {
+		uint64_t one = 1;
+		if (write(self->txEvent, &one, sizeof(one)) < 0) { /* counter overflow: already signaled */ }
+	}
+	return size;
+}
+
+/*
+ * returns the next record and its validated length or NULL if the ring is empty;
+ * the ring is written by the peer: a record out of the ring or beyond the tail breaks the channel
+ */
+static const uint8_t *peekRecord(ShmSocket self, uint32_t *len)
+{
+	if (self->broken) return NULL;
+	uint64_t head = self->rx->head; // own
+	uint64_t tail = __atomic_load_n(&self->rx->tail, __ATOMIC_SEQ_CST);
+	if (head == tail) return NULL;
+	if (tail - head > self->ringSize) goto exit_broken;
+	uint32_t off = (uint32_t)(head & (self->ringSize - 1));
+	uint32_t size = *((const volatile uint32_t *)(self->rxData + off));
+	if (size == SHM_REC_PAD) {
+		head += self->ringSize - off;
+		if (head > tail) goto exit_broken;
+		__atomic_store_n(&self->rx->head, head, __ATOMIC_SEQ_CST);
+		if (head == tail) return NULL;
+		off = 0;
+		size = *((const volatile uint32_t *)(self->rxData));
+	}
+	if (size == 0 || size > self->ringSize / 4) goto exit_broken;
+	if (off + recordSize(size) > self->ringSize || head + recordSize(size) > tail) goto exit_broken;
+	*len = size;
+	return self->rxData + off;
+
+exit_broken:
+	self->broken = true;
+	return NULL;
+}
+
+static const uint8_t *waitRecord(ShmSocket self, uint32_t *len, bool *closed)
+{
+	*closed = false;
+	const uint8_t *rec = peekRecord(self, len);
+	if (rec || self->broken) return rec;
+	uint64_t cnt;
+	if (read(self->rxEvent, &cnt, sizeof(cnt)) < 0) { /* not signaled */ }
+	rec = peekRecord(self, len);
+	if (rec == NULL) {
+		*closed = (__atomic_load_n(&self->hdr->closed, __ATOMIC_ACQUIRE) != 0);
+	}
+	return rec;
+}
+
+int ShmSocket_readAvailable(ShmSocket self)
+{
+	if (self == NULL) return -1;
+	uint32_t len;
+	const uint8_t *rec = peekRecord(self, &len);
+	if (rec) return (int)len;
+	if (self->broken) return -1;
+	return (__atomic_load_n(&self->hdr->closed, __ATOMIC_ACQUIRE))? -1 : 0;
+}
+
+int ShmSocket_read(ShmSocket self, uint8_t *buf, int size)
+{
+	if (self == NULL || buf == NULL || size < 0) return -1;
+	bool closed;
+	uint32_t len;
+	const uint8_t *rec = waitRecord(self, &len, &closed);
+	if (rec == NULL) return (closed || self->broken)? -1 : 0;
+	int cnt = ((uint32_t)size < len)? size : (int)len;
+	memcpy(buf, rec + sizeof(uint32_t), cnt);
+	// the pad marker (if any) is already skipped by peekRecord
+	__atomic_store_n(&self->rx->head, self->rx->head + recordSize(len), __ATOMIC_SEQ_CST);
+	return cnt;
+}
+
+unidesc ShmSocket_getDescriptor(ShmSocket self)
+{
+	if (self) {
+		unidesc ret;
+		ret.i32 = self->rxEvent;
+		return ret;
+	}
+	return Hal_getInvalidUnidesc();
+}
+
+void ShmSocket_destroy(ShmSocket self)
+{
+	if (self == NULL) return;
+	__atomic_store_n(&self->hdr->closed, 1, __ATOMIC_RELEASE);
+	uint64_t one = 1;
+	if (write(self->txEvent, &one, sizeof(one)) < 0) { /* already signaled */ }
+	munmap(self->hdr, self->mapSize);
+	close(self->rxEvent);
+	close(self->txEvent);
+	free(self);
+}
+
+#else
+
+ShmSocket ShmSocket_create(ClientSocket channel, uint32_t ringSize)
+{
+	(void)channel; (void)ringSize;
+	return NULL;
+}
+
+ShmSocket ShmSocket_open(ClientSocket channel, uint32_t timeoutInMs)
+{
+	(void)channel; (void)timeoutInMs;
+	return NULL;
+}
+
+int ShmSocket_write(ShmSocket self, const uint8_t *buf, int size)
+{
+	(void)self; (void)buf; (void)size;
+	return -1;
+}
+
+int ShmSocket_readAvailable(ShmSocket self)
+{
+	(void)self;
+	return -1;
+}
+
+int ShmSocket_read(ShmSocket self, uint8_t *buf, int size)
+{
+	(void)self; (void)buf; (void)size;
+	return -1;
+}
+
+unidesc ShmSocket_getDescriptor(ShmSocket self)
+{
+	(void)self;
+	return Hal_getInvalidUnidesc();
+}
+
+void ShmSocket_destroy(ShmSocket self)
+{
+	(void)self;
+}
+
+#endif
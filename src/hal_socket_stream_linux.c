@@ -5,6 +5,8 @@
 #define _GNU_SOURCE
 #endif
 
+#include "hal_poll_deadline.h"
+#include "hal_resolver.h"
 #include "hal_socket_stream.h"
 #include "hal_thread.h"
 #include "hal_utils.h"
@@ -14,6 +16,7 @@
 #include <fcntl.h>
 #include <ifaddrs.h>
 #include <linux/if_packet.h>
+#include <linux/tls.h>
 #include <linux/uinput.h>
 #include <linux/version.h>
 #include <netdb.h>
@@ -22,6 +25,7 @@
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,6 +44,18 @@
 
 // our kernel supports it
 #define TCP_USER_TIMEOUT	18
+#ifndef TCP_FASTOPEN
+#define TCP_FASTOPEN		23
+#endif
+#ifndef MSG_FASTOPEN
+#define MSG_FASTOPEN		0x20000000
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP				31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS				282
+#endif
 
 
 struct sClientSocket {
@@ -51,6 +67,20 @@ struct sClientSocket {
 	ServerSocket server;
 	int idx;
 	struct sServerClient list;
+	struct sClientSocket *prev;		// previous active client (NULL for first)
+	struct sClientSocket *nextFree;	// next free slot (valid while the slot is free)
+	struct sPollConnect *pconn;		// pending ClientSocket_connectPoll
+	struct sockaddr_storage peerAddr;	// cached at accept/connect
+	socklen_t peerAddrLen;			// 0 - not cached (or not connected yet)
+	struct sockaddr_storage localAddr;	// cached at first request
+	socklen_t localAddrLen;			// 0 - not cached
+};
+
+struct sPollConnect {
+	HalPoll poll;
+	PollDeadline deadline;		// shared timer of the poll
+	void *user;
+	ClientSocketConnectHandler handler;
 };
 
 struct sClients {
@@ -58,16 +88,95 @@ struct sClients {
 	int size;
 	int maxConnections;
 	struct sClientSocket *self;
+	struct sClientSocket *free;		// stack of the free slots
+	struct sClientSocket *head;		// active clients in accept order
+	struct sClientSocket *tail;
 };
 
 struct sServerSocket {
 	int fd;
 	int domain;
 	struct sClients clients;
+	bool hasOptions;
+	HalSocketOptions options;		// applied to the accepted clients
+};
+
+
+/*
+ * Private copy of struct tcp_info of the kernel (include/uapi/linux/tcp.h): the libc
+ * versions lack the fields of the newer kernels and differ (glibc, musl), <linux/tcp.h>
+ * conflicts with <netinet/tcp.h>. The layout is the kernel ABI: the fields are only appended.
+ */
+struct sTcpInfo {
+	uint8_t tcpi_state;
+	uint8_t tcpi_ca_state;
+	uint8_t tcpi_retransmits;
+	uint8_t tcpi_probes;
+	uint8_t tcpi_backoff;
+	uint8_t tcpi_options;
+	uint8_t tcpi_wscale;			// snd:4, rcv:4
+	uint8_t tcpi_flags;				// delivery_rate_app_limited:1, fastopen_client_fail:2
+
+	uint32_t tcpi_rto;
+	uint32_t tcpi_ato;
+	uint32_t tcpi_snd_mss;
+	uint32_t tcpi_rcv_mss;
+
+	uint32_t tcpi_unacked;
+	uint32_t tcpi_sacked;
+	uint32_t tcpi_lost;
+	uint32_t tcpi_retrans;
+	uint32_t tcpi_fackets;
+
+	uint32_t tcpi_last_data_sent;
+	uint32_t tcpi_last_ack_sent;
+	uint32_t tcpi_last_data_recv;
+	uint32_t tcpi_last_ack_recv;
+
+	uint32_t tcpi_pmtu;
+	uint32_t tcpi_rcv_ssthresh;
+	uint32_t tcpi_rtt;
+	uint32_t tcpi_rttvar;
+	uint32_t tcpi_snd_ssthresh;
+	uint32_t tcpi_snd_cwnd;
+	uint32_t tcpi_advmss;
+	uint32_t tcpi_reordering;
+
+	uint32_t tcpi_rcv_rtt;
+	uint32_t tcpi_rcv_space;
+
+	uint32_t tcpi_total_retrans;
+
+	uint64_t tcpi_pacing_rate;		// offset 104
+	uint64_t tcpi_max_pacing_rate;
+	uint64_t tcpi_bytes_acked;
+	uint64_t tcpi_bytes_received;
+	uint32_t tcpi_segs_out;
+	uint32_t tcpi_segs_in;
+
+	uint32_t tcpi_notsent_bytes;
+	uint32_t tcpi_min_rtt;
+	uint32_t tcpi_data_segs_in;
+	uint32_t tcpi_data_segs_out;
+
+	uint64_t tcpi_delivery_rate;
+
+	uint64_t tcpi_busy_time;
+	uint64_t tcpi_rwnd_limited;
+	uint64_t tcpi_sndbuf_limited;
+
+	uint32_t tcpi_delivered;
+	uint32_t tcpi_delivered_ce;
+
+	uint64_t tcpi_bytes_sent;
+	uint64_t tcpi_bytes_retrans;
 };
 
+#define TCP_INFO_HAS(info, len, field) ((len) >= offsetof(struct sTcpInfo, field) + sizeof((info).field))
 
-static bool prepareSocketAddress(const char *address, uint16_t port, struct sockaddr_in *sockaddr);
+HAL_INTERNAL HalResolver HalResolver_getSocketResolver(void);
+HAL_INTERNAL HalResolveState HalResolver_lookupAddress(HalResolver self, const char *host, int family, struct sockaddr_storage *sockaddr);
+static bool prepareSocketAddress(const char *address, uint16_t port, int family, struct sockaddr_storage *sockaddr, socklen_t *len);
 
 
 static inline void setSocketNonBlocking(int fd)
@@ -76,6 +185,54 @@ static inline void setSocketNonBlocking(int fd)
 	fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
+static inline bool isInetDomain(int domain)
+{
+	return (domain == AF_INET || domain == AF_INET6);
+}
+
+/* AF_INET6 sockets are dual-stack: IPv4 peers are seen as v4-mapped addresses */
+static int createInetSocket(int domain)
+{
+	int fd = socket(domain, SOCK_STREAM, 0);
+	if (fd >= 0 && domain == AF_INET6) {
+		int optval = 0;
+		setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &optval, sizeof(optval));
+	}
+	return fd;
+}
+
+static bool setIntOption(int fd, int level, int name, int value)
+{
+	return (setsockopt(fd, level, name, &value, sizeof(value)) == 0);
+}
+
+static bool setBufferOptions(int fd, const HalSocketOptions *options)
+{
+	bool ret = true;
+	if (options->sendBufferSize > 0) ret &= setIntOption(fd, SOL_SOCKET, SO_SNDBUF, options->sendBufferSize);
+	if (options->receiveBufferSize > 0) ret &= setIntOption(fd, SOL_SOCKET, SO_RCVBUF, options->receiveBufferSize);
+	return ret;
+}
+
+static bool applySocketOptions(int fd, const HalSocketOptions *options)
+{
+	bool ret = setBufferOptions(fd, options);
+	if (options->noDelay) ret &= setIntOption(fd, IPPROTO_TCP, TCP_NODELAY, 1);
+	if (options->quickAck) ret &= setIntOption(fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+	if (options->notSentLowat > 0) ret &= setIntOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, options->notSentLowat);
+	if (options->keepAliveIdle > 0) {
+		ret &= setIntOption(fd, SOL_SOCKET, SO_KEEPALIVE, 1);
+		ret &= setIntOption(fd, IPPROTO_TCP, TCP_KEEPIDLE, options->keepAliveIdle);
+		if (options->keepAliveInterval > 0) ret &= setIntOption(fd, IPPROTO_TCP, TCP_KEEPINTVL, options->keepAliveInterval);
+		if (options->keepAliveCount > 0) ret &= setIntOption(fd, IPPROTO_TCP, TCP_KEEPCNT, options->keepAliveCount);
+	}
+	if (options->unacknowledgedTimeoutInMs > 0) ret &= setIntOption(fd, SOL_TCP, TCP_USER_TIMEOUT, options->unacknowledgedTimeoutInMs);
+	if (options->busyPollInUs > 0) ret &= setIntOption(fd, SOL_SOCKET, SO_BUSY_POLL, options->busyPollInUs);
+	if (options->priority > 0) ret &= setIntOption(fd, SOL_SOCKET, SO_PRIORITY, options->priority);
+	if (options->mark) ret &= setIntOption(fd, SOL_SOCKET, SO_MARK, (int)options->mark);
+	return ret;
+}
+
 static inline void disableSocketTimeWait(int fd)
 {
 	struct linger lin = { .l_onoff = 1, .l_linger = 0 };
@@ -91,22 +248,50 @@ static inline int getSocketAvailableToRead(int fd)
 	return -1;
 }
 
+static inline void cacheAddress(struct sockaddr_storage *dst, socklen_t *dstLen, const void *addr, socklen_t addrLen)
+{
+	memset(dst, 0, sizeof(struct sockaddr_storage));
+	memcpy(dst, addr, addrLen);
+	*dstLen = addrLen;
+}
 
-ServerSocket TcpServerSocket_create(int maxConnections, const char *address, uint16_t port)
+static inline void clearCachedAddresses(ClientSocket self)
 {
-	if (port == 0) return NULL;
+	self->peerAddrLen = 0;
+	self->localAddrLen = 0;
+}
+
+static void initClientsTable(struct sClients *clients, int maxConnections)
+{
+	clients->maxConnections = maxConnections;
+	clients->size = 0;
+	clients->head = NULL;
+	clients->tail = NULL;
+	clients->free = NULL;
+	for (int i = maxConnections-1; i >= 0; --i) {
+		clients->self[i].fd = -1;
+		clients->self[i].idx = -1;
+		clients->self[i].nextFree = clients->free;
+		clients->free = &(clients->self[i]);
+	}
+}
+
 
-	int fd = socket(AF_INET, SOCK_STREAM, 0);
+static ServerSocket createTcpServerSocket(int maxConnections, const struct sockaddr_storage *serverAddress, socklen_t addressLen, bool reusePort)
+{
+	int fd = createInetSocket(serverAddress->ss_family);
 	if (fd < 0) return NULL;
 
-	struct sockaddr_in serverAddress;
 	Mutex mu = NULL;
 	ServerSocket self;
 
-	if (!prepareSocketAddress(address, port, &serverAddress)) {
-		goto exit_error;
+	if (reusePort) {
+		int optval = 1;
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0) {
+			goto exit_error;
+		}
 	}
-	if (bind(fd, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) < 0) {
+	if (bind(fd, (const struct sockaddr *)serverAddress, addressLen) < 0) {
 		goto exit_error;
 	}
 
@@ -122,9 +307,9 @@ ServerSocket TcpServerSocket_create(int maxConnections, const char *address, uin
 		self->clients.self = (struct sClientSocket *)calloc(maxConnections, sizeof(struct sClientSocket));
 		if (self->clients.self) {
 			self->fd = fd;
-			self->domain = AF_INET;
-			self->clients.maxConnections = maxConnections;
+			self->domain = serverAddress->ss_family;
 			self->clients.mu = mu;
+			initClientsTable(&self->clients, maxConnections);
 			setSocketNonBlocking(fd);
 			return self;
 		} else { free(self); }
@@ -136,22 +321,77 @@ exit_error:
 	return NULL;
 }
 
+ServerSocket TcpServerSocket_create(int maxConnections, const char *address, uint16_t port)
+{
+	if (port == 0) return NULL;
+
+	struct sockaddr_storage serverAddress;
+	socklen_t addressLen;
+	if (!prepareSocketAddress(address, port, AF_UNSPEC, &serverAddress, &addressLen)) {
+		return NULL;
+	}
 
-ClientSocket TcpClientSocket_createAndBind(const char *ip, uint16_t port)
+	return createTcpServerSocket(maxConnections, &serverAddress, addressLen, false);
+}
+
+bool TcpServerSocket_createShards(ServerSocket *shards, int shardsNumber, int maxConnections, const char *address, uint16_t port)
 {
-	int fd = socket(AF_INET, SOCK_STREAM, 0);
-	if (fd < 0) return NULL;
+	if (shards == NULL || shardsNumber <= 0 || port == 0) return false;
 
+	struct sockaddr_storage serverAddress;
+	socklen_t addressLen;
+	if (!prepareSocketAddress(address, port, AF_UNSPEC, &serverAddress, &addressLen)) {
+		return false;
+	}
+
+	for (int i = 0; i < shardsNumber; ++i) {
+		shards[i] = createTcpServerSocket(maxConnections, &serverAddress, addressLen, true);
+		if (shards[i] == NULL) {
+			while (i--) {
+				ServerSocket_destroy(shards[i]);
+				shards[i] = NULL;
+			}
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool TcpServerSocket_activateFastOpen(ServerSocket self, int queueLength)
+{
+	if (self == NULL || !isInetDomain(self->domain)) return false;
+	return (setsockopt(self->fd, IPPROTO_TCP, TCP_FASTOPEN, &queueLength, sizeof(queueLength)) == 0);
+}
+
+
+ClientSocket TcpClientSocket_createAndBind(const char *ip, uint16_t port)
+{
+	int fd = -1;
+	int domain;
 	ClientSocket self;
 
 	if (ip || port) {
-		struct sockaddr_in addr;
-		if (!prepareSocketAddress(ip, port, &addr)) {
-			goto exit_error;
+		struct sockaddr_storage addr;
+		socklen_t addrLen;
+		if (!prepareSocketAddress(ip, port, AF_UNSPEC, &addr, &addrLen)) {
+			return NULL;
 		}
-		if (bind(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in)) < 0) {
+		domain = addr.ss_family;
+		fd = createInetSocket(domain);
+		if (fd < 0) return NULL;
+		if (bind(fd, (struct sockaddr*)&addr, addrLen) < 0) {
 			goto exit_error;
 		}
+	} else {
+		// not bound: dual-stack if IPv6 is available
+		domain = AF_INET6;
+		fd = createInetSocket(domain);
+		if (fd < 0) {
+			domain = AF_INET;
+			fd = createInetSocket(domain);
+			if (fd < 0) return NULL;
+		}
 	}
 
 	disableSocketTimeWait(fd);
@@ -159,7 +399,7 @@ ClientSocket TcpClientSocket_createAndBind(const char *ip, uint16_t port)
 	self = (ClientSocket)calloc(1, sizeof(struct sClientSocket));
 	if (self) {
 		self->fd = fd;
-		self->domain = AF_INET;
+		self->domain = domain;
 		self->inreset = true;
 		self->userData = NULL;
 		self->server = NULL;
@@ -207,6 +447,147 @@ void TcpClientSocket_setUnacknowledgedTimeout(ClientSocket self, int timeoutInMs
 	setsockopt(self->fd, SOL_TCP, TCP_USER_TIMEOUT, &timeoutInMs, sizeof(timeoutInMs));
 }
 
+bool TcpClientSocket_applyOptions(ClientSocket self, const HalSocketOptions *options)
+{
+	if (self == NULL || options == NULL) return false;
+	if (self->fd == -1 || !isInetDomain(self->domain)) return false;
+	return applySocketOptions(self->fd, options);
+}
+
+bool TcpServerSocket_setClientOptions(ServerSocket self, const HalSocketOptions *options)
+{
+	if (self == NULL || !isInetDomain(self->domain)) return false;
+	if (options == NULL) {
+		self->hasOptions = false;
+		return true;
+	}
+	self->options = *options;
+	self->hasOptions = true;
+	return setBufferOptions(self->fd, options);
+}
+
+static bool setTlsCryptoInfo(int fd, int direction, const TcpTlsCryptoInfo *info)
+{
+	switch (info->cipher) {
+		case TCP_TLS_CIPHER_AES_GCM_128: {
+			struct tls12_crypto_info_aes_gcm_128 ci;
+			memset(&ci, 0, sizeof(ci));
+			ci.info.version = info->version;
+			ci.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+			memcpy(ci.key, info->key, TLS_CIPHER_AES_GCM_128_KEY_SIZE);
+			memcpy(ci.iv, info->iv, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+			memcpy(ci.salt, info->salt, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+			memcpy(ci.rec_seq, info->recSeq, TLS_CIPHER_AES_GCM_128_REC_SEQ_SIZE);
+			return (setsockopt(fd, SOL_TLS, direction, &ci, sizeof(ci)) == 0);
+		}
+		case TCP_TLS_CIPHER_AES_GCM_256: {
+			struct tls12_crypto_info_aes_gcm_256 ci;
+			memset(&ci, 0, sizeof(ci));
+			ci.info.version = info->version;
+			ci.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+			memcpy(ci.key, info->key, TLS_CIPHER_AES_GCM_256_KEY_SIZE);
+			memcpy(ci.iv, info->iv, TLS_CIPHER_AES_GCM_256_IV_SIZE);
+			memcpy(ci.salt, info->salt, TLS_CIPHER_AES_GCM_256_SALT_SIZE);
+			memcpy(ci.rec_seq, info->recSeq, TLS_CIPHER_AES_GCM_256_REC_SEQ_SIZE);
+			return (setsockopt(fd, SOL_TLS, direction, &ci, sizeof(ci)) == 0);
+		}
+		case TCP_TLS_CIPHER_CHACHA20_POLY1305: {
+			struct tls12_crypto_info_chacha20_poly1305 ci;
+			memset(&ci, 0, sizeof(ci));
+			ci.info.version = info->version;
+			ci.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+			memcpy(ci.key, info->key, TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE);
+			memcpy(ci.iv, info->iv, TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE);
+			memcpy(ci.rec_seq, info->recSeq, TLS_CIPHER_CHACHA20_POLY1305_REC_SEQ_SIZE);
+			return (setsockopt(fd, SOL_TLS, direction, &ci, sizeof(ci)) == 0);
+		}
+		default: break;
+	}
+	errno = EINVAL;
+	return false;
+}
+
+bool TcpClientSocket_activateTls(ClientSocket self, const TcpTlsCryptoInfo *tx, const TcpTlsCryptoInfo *rx)
+{
+	if (self == NULL || (tx == NULL && rx == NULL)) return false;
+	if (self->fd == -1 || self->inreset || !isInetDomain(self->domain)) return false;
+	if (setsockopt(self->fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) < 0) {
+		return false;
+	}
+	if (tx && !setTlsCryptoInfo(self->fd, TLS_TX, tx)) return false;
+	if (rx && !setTlsCryptoInfo(self->fd, TLS_RX, rx)) return false;
+	return true;
+}
+
+int TcpClientSocket_writeTlsRecord(ClientSocket self, uint8_t recordType, const uint8_t *buf, int size)
+{
+	if (self == NULL || buf == NULL || size < 0) return -1;
+	if (self->fd == -1) return -1;
+
+	union {
+		char buf[CMSG_SPACE(sizeof(uint8_t))];
+		struct cmsghdr align;
+	} control;
+	struct iovec iov;
+	struct msghdr msg;
+
+	iov.iov_base = (void *)buf;
+	iov.iov_len = size;
+	memset(&msg, 0, sizeof(msg));
+	memset(&control, 0, sizeof(control));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_TLS;
+	cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint8_t));
+	*CMSG_DATA(cmsg) = recordType;
+
+	int retVal = sendmsg(self->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (retVal < 0) {
+		return (errno == EAGAIN || errno == EWOULDBLOCK)? 0 : -1;
+	}
+	return retVal;
+}
+
+int TcpClientSocket_readTlsRecord(ClientSocket self, uint8_t *recordType, uint8_t *buf, int size)
+{
+	if (self == NULL || recordType == NULL || buf == NULL || size < 0) return -1;
+	if (self->fd == -1) return -1;
+
+	union {
+		char buf[CMSG_SPACE(sizeof(uint8_t))];
+		struct cmsghdr align;
+	} control;
+	struct iovec iov;
+	struct msghdr msg;
+
+	iov.iov_base = buf;
+	iov.iov_len = size;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	int read_bytes = recvmsg(self->fd, &msg, MSG_DONTWAIT);
+	if (read_bytes == 0) // eof
+		return -1;
+	if (read_bytes < 0) {
+		return (errno == EAGAIN || errno == EWOULDBLOCK)? 0 : -1;
+	}
+
+	*recordType = TCP_TLS_RECORD_APPLICATION_DATA;
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_TLS && cmsg->cmsg_type == TLS_GET_RECORD_TYPE) {
+			*recordType = *CMSG_DATA(cmsg);
+		}
+	}
+	return read_bytes;
+}
+
 
 ServerSocket LocalServerSocket_create(int maxConnections, const char *address)
 {
@@ -236,8 +617,8 @@ ServerSocket LocalServerSocket_create(int maxConnections, const char *address)
 		if (self->clients.self) {
 			self->fd = fd;
 			self->domain = AF_UNIX;
-			self->clients.maxConnections = maxConnections;
 			self->clients.mu = mu;
+			initClientsTable(&self->clients, maxConnections);
 			setSocketNonBlocking(fd);
 			return self;
 		} else { free(self); }
@@ -279,6 +660,31 @@ ClientSocket LocalClientSocket_create(void)
 }
 
 
+ClientSocket ClientSocket_createFromDescriptor(unidesc ud)
+{
+	int fd = ud.i32;
+	int type, domain;
+	socklen_t len = sizeof(int);
+	if (fd < 0) return NULL;
+	if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0 || type != SOCK_STREAM) return NULL;
+	len = sizeof(int);
+	if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &len) < 0) return NULL;
+	if (!isInetDomain(domain) && domain != AF_UNIX) return NULL;
+
+	ClientSocket self = (ClientSocket)calloc(1, sizeof(struct sClientSocket));
+	if (self) {
+		self->fd = fd;
+		self->domain = domain;
+		self->inreset = false;
+		self->userData = NULL;
+		self->server = NULL;
+		self->idx = -1;
+		setSocketNonBlocking(fd);
+	}
+	return self;
+}
+
+
 void ServerSocket_listen(ServerSocket self, int pending)
 {
 	if (self == NULL) return;
@@ -290,33 +696,48 @@ ClientSocket ServerSocket_accept(ServerSocket self)
 	if (self == NULL) return NULL;
 
 	int fd;
+	struct sockaddr_storage peerAddr;
+	socklen_t peerAddrLen = sizeof(peerAddr);
 
 	ClientSocket conSocket = NULL;
-	fd = accept(self->fd, NULL, NULL);
+	memset(&peerAddr, 0, sizeof(peerAddr));
+	fd = accept(self->fd, (struct sockaddr *)&peerAddr, &peerAddrLen);
 
 	if (fd >= 0) {
 		disableSocketTimeWait(fd);
 		setSocketNonBlocking(fd);
+		if (self->hasOptions) {
+			applySocketOptions(fd, &self->options);
+		}
 
 		HalMutex_lock(self->clients.mu);
 		{
-			if (self->clients.size >= self->clients.maxConnections) {
+			conSocket = self->clients.free;
+			if (conSocket == NULL) {
 				HalMutex_unlock(self->clients.mu);
 				goto exit_error;
 			}
-			for (int i = 0; i < self->clients.maxConnections; ++i) {
-				if ( self->clients.self[i].server == NULL ) {
-					conSocket = &(self->clients.self[i]);
-					conSocket->fd = fd;
-					conSocket->domain = self->domain;
-					conSocket->inreset = false;
-					conSocket->userData = NULL;
-					conSocket->server = self;
-					conSocket->idx = i;
-					self->clients.size++;
-					break;
-				}
+			self->clients.free = conSocket->nextFree;
+			conSocket->nextFree = NULL;
+			conSocket->fd = fd;
+			conSocket->domain = self->domain;
+			conSocket->inreset = false;
+			conSocket->userData = NULL;
+			conSocket->server = self;
+			conSocket->idx = (int)(conSocket - self->clients.self);
+			cacheAddress(&conSocket->peerAddr, &conSocket->peerAddrLen, &peerAddr, peerAddrLen);
+			conSocket->localAddrLen = 0;
+			// append to the active list
+			conSocket->list.self = conSocket;
+			conSocket->list.next = NULL;
+			conSocket->prev = self->clients.tail;
+			if (self->clients.tail) {
+				self->clients.tail->list.next = &(conSocket->list);
+			} else {
+				self->clients.head = conSocket;
 			}
+			self->clients.tail = conSocket;
+			self->clients.size++;
 		}
 		HalMutex_unlock(self->clients.mu);
 	}
@@ -340,34 +761,98 @@ int ServerSocket_getClientsNumber(ServerSocket self)
 ServerClient ServerSocket_getClients(ServerSocket self)
 {
 	ServerClient ret = NULL;
-	ServerClient it = NULL;
 	if (self == NULL) return NULL;
 	HalMutex_lock(self->clients.mu);
-	if (self->clients.size > 0) {
-		for (int i = 0; i < self->clients.maxConnections; ++i) {
-			ClientSocket c = &(self->clients.self[i]);
-			if (c->server != NULL) {
-				if (it) it->next = &(c->list);
-				it = &(c->list);
-				it->self = c;
-				it->next = NULL;
-				if (ret == NULL) ret = it;
-			}
-		}
+	if (self->clients.head) {
+		ret = &(self->clients.head->list);
 	}
 	HalMutex_unlock(self->clients.mu);
 	return ret;
 }
 
+static bool getTcpStats(int fd, HalTcpStats *stats)
+{
+	struct sTcpInfo info;
+	socklen_t len = sizeof(info);
+	memset(&info, 0, sizeof(info));
+	if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0) return false;
+
+	memset(stats, 0, sizeof(HalTcpStats));
+	stats->rttInUs = info.tcpi_rtt;
+	stats->rttVarInUs = info.tcpi_rttvar;
+	stats->mss = info.tcpi_snd_mss;
+	stats->cwnd = info.tcpi_snd_cwnd;
+	stats->unacked = info.tcpi_unacked;
+	stats->lost = info.tcpi_lost;
+	stats->retransmits = info.tcpi_total_retrans;
+	// zero-filled if the kernel is older
+	stats->minRttInUs = info.tcpi_min_rtt;
+	stats->notSentBytes = info.tcpi_notsent_bytes;
+	stats->deliveryRate = info.tcpi_delivery_rate;
+	stats->bytesAcked = info.tcpi_bytes_acked;
+	stats->bytesReceived = info.tcpi_bytes_received;
+	stats->bytesSent = info.tcpi_bytes_sent;
+	if (TCP_INFO_HAS(info, len, tcpi_bytes_retrans) && info.tcpi_bytes_sent >= info.tcpi_bytes_retrans + info.tcpi_bytes_acked) {
+		stats->unackedBytes = info.tcpi_bytes_sent - info.tcpi_bytes_retrans - info.tcpi_bytes_acked;
+	} else {
+		stats->unackedBytes = (uint64_t)info.tcpi_unacked * info.tcpi_snd_mss;
+	}
+	return true;
+}
+
+bool ServerSocket_getStats(ServerSocket self, HalTcpServerStats *stats)
+{
+	if (self == NULL || stats == NULL || !isInetDomain(self->domain)) return false;
+	memset(stats, 0, sizeof(HalTcpServerStats));
+	uint64_t rttSum = 0;
+	HalTcpStats cs;
+	HalMutex_lock(self->clients.mu);
+	for (ClientSocket c = self->clients.head; c; c = (c->list.next)? c->list.next->self : NULL) {
+		if (!getTcpStats(c->fd, &cs)) continue;
+		stats->clients++;
+		rttSum += cs.rttInUs;
+		if (cs.rttInUs > stats->maxRttInUs) stats->maxRttInUs = cs.rttInUs;
+		stats->retransmits += cs.retransmits;
+		stats->unackedBytes += cs.unackedBytes;
+		stats->notSentBytes += cs.notSentBytes;
+		stats->deliveryRate += cs.deliveryRate;
+		stats->bytesSent += cs.bytesSent;
+		stats->bytesAcked += cs.bytesAcked;
+		stats->bytesReceived += cs.bytesReceived;
+	}
+	HalMutex_unlock(self->clients.mu);
+	if (stats->clients) {
+		stats->avgRttInUs = (uint32_t)(rttSum / stats->clients);
+	}
+	return true;
+}
+
 static void ServerSocket_deleteClient(ServerSocket self, ClientSocket client)
 {
 	if (self == NULL || client == NULL) return;
 	if (client->idx >= 0) {
 		HalMutex_lock(self->clients.mu);
 		{
+			// unlink from the active list
+			ClientSocket next = (client->list.next)? client->list.next->self : NULL;
+			if (client->prev) {
+				client->prev->list.next = client->list.next;
+			} else {
+				self->clients.head = next;
+			}
+			if (next) {
+				next->prev = client->prev;
+			} else {
+				self->clients.tail = client->prev;
+			}
+			client->list.next = NULL;
+			client->prev = NULL;
+			// return the slot
 			client->inreset = true;
 			client->server = NULL;
 			client->idx = -1;
+			client->nextFree = self->clients.free;
+			self->clients.free = client;
 			self->clients.size--;
 		}
 		HalMutex_unlock(self->clients.mu);
@@ -386,13 +871,11 @@ void ServerSocket_closeClients(ServerSocket self)
 {
 	if (self == NULL) return;
 	HalMutex_lock(self->clients.mu);
-	if (self->clients.size > 0) {
-		for (int i = 0; i < self->clients.maxConnections; ++i) {
-			ClientSocket c = &(self->clients.self[i]);
-			if (c->server != NULL) {
-				ServerSocket_deleteClient(self, c);
-			}
-		}
+	ClientSocket c = self->clients.head;
+	while (c != NULL) {
+		ClientSocket next = (c->list.next)? c->list.next->self : NULL;
+		ServerSocket_deleteClient(self, c);
+		c = next;
 	}
 	HalMutex_unlock(self->clients.mu);
 }
@@ -426,14 +909,19 @@ bool ClientSocket_connectAsync(ClientSocket self, const ClientSocketAddress addr
 	if (self->server) return false;
 
 	switch (self->domain) {
-		case AF_INET: {
-			struct sockaddr_in serverAddress;
-			if (!prepareSocketAddress(address->ip, address->port, &serverAddress))
+		case AF_INET:
+		case AF_INET6: {
+			struct sockaddr_storage serverAddress;
+			socklen_t addressLen;
+			if (!prepareSocketAddress(address->ip, address->port, self->domain, &serverAddress, &addressLen))
 				return false;
-			if (connect(self->fd, (struct sockaddr *) &serverAddress, sizeof(serverAddress)) < 0) {
+			if (connect(self->fd, (struct sockaddr *) &serverAddress, addressLen) < 0) {
 				if (errno != EINPROGRESS) {
 					return false;
 				}
+				// the peer address is cached once the connection is established
+			} else {
+				cacheAddress(&self->peerAddr, &self->peerAddrLen, &serverAddress, addressLen);
 			}
 		} break;
 		case AF_UNIX: {
@@ -443,6 +931,7 @@ bool ClientSocket_connectAsync(ClientSocket self, const ClientSocketAddress addr
 			if (connect(self->fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) < 0) {
 				return false;
 			}
+			cacheAddress(&self->peerAddr, &self->peerAddrLen, &addr, sizeof(struct sockaddr_un));
 		} break;
 	}
 
@@ -458,15 +947,12 @@ bool ClientSocket_connect(ClientSocket self, const ClientSocketAddress address,
 	if (ClientSocket_connectAsync(self, address) == false)
 		return false;
 
-	struct timeval timeout;
-	timeout.tv_sec = timeoutInMs / 1000;
-	timeout.tv_usec = (timeoutInMs % 1000) * 1000;
-
-	fd_set fdSet;
-	FD_ZERO(&fdSet);
-	FD_SET(self->fd, &fdSet);
+	struct pollfd pfd;
+	pfd.fd = self->fd;
+	pfd.events = POLLOUT;
+	pfd.revents = 0;
 
-	if (select(self->fd + 1, NULL, &fdSet , NULL, &timeout) == 1) {
+	if (poll(&pfd, 1, (int)timeoutInMs) == 1 && (pfd.revents & (POLLOUT|POLLERR))) {
 		int so_error;
 		socklen_t len = sizeof so_error;
 		if (getsockopt(self->fd, SOL_SOCKET, SO_ERROR, &so_error, &len) >= 0) {
@@ -477,6 +963,121 @@ bool ClientSocket_connect(ClientSocket self, const ClientSocketAddress address,
 	}
 
 	self->inreset = true;
+	clearCachedAddresses(self);
+	return false;
+}
+
+int ClientSocket_connectWithData(ClientSocket self, const ClientSocketAddress address, const uint8_t *buf, int size)
+{
+	if (self == NULL || address == NULL || buf == NULL) return -1;
+	if (self->server || !isInetDomain(self->domain)) return -1;
+
+	struct sockaddr_storage serverAddress;
+	socklen_t addressLen;
+	if (!prepareSocketAddress(address->ip, address->port, self->domain, &serverAddress, &addressLen))
+		return -1;
+
+	int rc = sendto(self->fd, buf, size, MSG_FASTOPEN | MSG_NOSIGNAL,
+			(struct sockaddr *)&serverAddress, addressLen);
+	if (rc < 0) {
+		switch (errno) {
+			case EINPROGRESS: // no cookie yet: SYN is sent without data
+			case EAGAIN:
+				rc = 0;
+				break;
+			case EOPNOTSUPP: // fast open is disabled by the system
+				return ClientSocket_connectAsync(self, address)? 0 : -1;
+			default:
+				return -1;
+		}
+	}
+
+	self->inreset = false;
+	return rc;
+}
+
+static void ClientSocket_endPollConnect(ClientSocket self)
+{
+	struct sPollConnect *pconn = self->pconn;
+	if (pconn == NULL) return;
+	HalPoll_remove(pconn->poll, ClientSocket_getDescriptor(self));
+	PollDeadline_cancel(&(pconn->deadline));
+	free(pconn);
+	self->pconn = NULL;
+}
+
+static void ClientSocket_completePollConnect(ClientSocket self, ClientSocketState state)
+{
+	struct sPollConnect *pconn = self->pconn;
+	void *user = pconn->user;
+	ClientSocketConnectHandler handler = pconn->handler;
+	ClientSocket_endPollConnect(self);
+	if (state != SOCKET_STATE_CONNECTED) {
+		self->inreset = true;
+		clearCachedAddresses(self);
+	}
+	if (handler) {
+		handler(user, self, state);
+	}
+}
+
+static void onPollConnectEvent(void *user, void *object, int revents)
+{
+	ClientSocket self = (ClientSocket)object;
+	(void)user;
+	(void)revents;
+	if (self->pconn == NULL) return;
+	int so_error = -1;
+	socklen_t len = sizeof(so_error);
+	if (getsockopt(self->fd, SOL_SOCKET, SO_ERROR, &so_error, &len) >= 0) {
+		ClientSocket_completePollConnect(self, (so_error == 0)? SOCKET_STATE_CONNECTED : SOCKET_STATE_FAILED);
+	} else {
+		ClientSocket_completePollConnect(self, SOCKET_STATE_FAILED);
+	}
+}
+
+static void onPollConnectTimeout(void *object)
+{
+	ClientSocket self = (ClientSocket)object;
+	if (self->pconn == NULL) return;
+	ClientSocket_completePollConnect(self, SOCKET_STATE_TIMEOUT);
+}
+
+bool ClientSocket_connectPoll(ClientSocket self, const ClientSocketAddress address, HalPoll poll,
+		uint32_t timeoutInMs, void *user, ClientSocketConnectHandler handler)
+{
+	if (self == NULL || address == NULL || poll == NULL) return false;
+	if (self->server || self->pconn) return false;
+
+	struct sPollConnect *pconn = (struct sPollConnect *)calloc(1, sizeof(struct sPollConnect));
+	if (pconn == NULL) return false;
+	pconn->poll = poll;
+	pconn->user = user;
+	pconn->handler = handler;
+
+	if (ClientSocket_connectAsync(self, address) == false) {
+		goto exit_error;
+	}
+
+	self->pconn = pconn;
+	if (!HalPoll_update(poll, ClientSocket_getDescriptor(self), HAL_POLLOUT, self, NULL, onPollConnectEvent)) {
+		goto exit_poll;
+	}
+	if (timeoutInMs) {
+		if (!PollDeadline_start(&(pconn->deadline), poll, timeoutInMs, self, onPollConnectTimeout)) {
+			goto exit_poll;
+		}
+	}
+
+	return true;
+
+exit_poll:
+	ClientSocket_endPollConnect(self);
+	self->inreset = true;
+	clearCachedAddresses(self);
+	return false;
+exit_error:
+	free(pconn);
 	return false;
 }
 
@@ -487,16 +1088,19 @@ HAL_INTERNAL void ClientSocket_close(ClientSocket self)
 		closeAndShutdownSocket(self->fd);
 		self->fd = -1;
 		self->inreset = true;
+		clearCachedAddresses(self);
 	}
 }
 
 bool ClientSocket_reset(ClientSocket self)
 {
 	if (self == NULL) return false;
+	ClientSocket_endPollConnect(self);
 	if (self->fd >= 0 && self->server == NULL) {
 		closeAndShutdownSocket(self->fd);
-		self->fd = socket(self->domain, SOCK_STREAM, 0);
+		self->fd = (isInetDomain(self->domain))? createInetSocket(self->domain) : socket(self->domain, SOCK_STREAM, 0);
 		self->inreset = true;
+		clearCachedAddresses(self);
 		if (self->fd >= 0) {
 			return true;
 		}
@@ -507,17 +1111,14 @@ bool ClientSocket_reset(ClientSocket self)
 ClientSocketState ClientSocket_checkConnectState(ClientSocket self)
 {
 	if (self == NULL) return SOCKET_STATE_ERROR_UNKNOWN;
-	fd_set fdSet;
-	struct timeval timeout;
-
-	memset(&timeout, 0, sizeof(struct timeval));
+	struct pollfd pfd;
+	pfd.fd = self->fd;
+	pfd.events = POLLOUT;
+	pfd.revents = 0;
 
-	FD_ZERO(&fdSet);
-	FD_SET(self->fd, &fdSet);
+	int pollVal = poll(&pfd, 1, 0);
 
-	int selectVal = select(self->fd+1, NULL, &fdSet , NULL, &timeout);
-
-	if (selectVal == 1) {
+	if (pollVal == 1 && (pfd.revents & (POLLOUT|POLLERR))) {
 		/* Check if connection is established */
 		int so_error;
 		socklen_t len = sizeof(so_error);
@@ -526,7 +1127,7 @@ ClientSocketState ClientSocket_checkConnectState(ClientSocket self)
 				return (self->inreset)? SOCKET_STATE_IDLE : SOCKET_STATE_CONNECTED;
 		}
 		return SOCKET_STATE_FAILED;
-	} else if (selectVal == 0) {
+	} else if (pollVal >= 0) {
 		return SOCKET_STATE_CONNECTING;
 	} else {
 		return SOCKET_STATE_FAILED;
@@ -556,6 +1157,30 @@ int ClientSocket_read(ClientSocket self, uint8_t *buf, int size)
 	return read_bytes;
 }
 
+int ClientSocket_receive(ClientSocket self, uint8_t *buf, int size, bool *more)
+{
+	if (more) *more = false;
+	if (self == NULL || buf == NULL) return -1;
+
+	if (self->fd == -1)
+		return -1;
+
+	int read_bytes = recv(self->fd, buf, size, MSG_DONTWAIT);
+
+	if (read_bytes == 0) // eof
+		return -1;
+
+	if (read_bytes < 0) {
+		switch (errno) {
+			case EAGAIN: return 0;
+			default: return -1;
+		}
+	}
+
+	if (more) *more = (read_bytes == size);
+	return read_bytes;
+}
+
 int ClientSocket_write(ClientSocket self, const uint8_t *buf, int size)
 {
 	if (self == NULL || buf == NULL) return -1;
@@ -577,6 +1202,101 @@ int ClientSocket_write(ClientSocket self, const uint8_t *buf, int size)
 	return retVal;
 }
 
+int ClientSocket_sendDescriptors(ClientSocket self, const unidesc *descs, int count, const uint8_t *buf, int size)
+{
+	if (self == NULL || descs == NULL) return -1;
+	if (self->fd == -1 || self->domain != AF_UNIX) return -1;
+	if (count <= 0 || count > CLIENT_SOCKET_MAX_DESCRIPTORS) return -1;
+
+	uint8_t dummy = 0;
+	union {
+		char buf[CMSG_SPACE(CLIENT_SOCKET_MAX_DESCRIPTORS * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct iovec iov;
+	struct msghdr msg;
+
+	if (buf == NULL || size <= 0) {
+		iov.iov_base = &dummy;
+		iov.iov_len = 1;
+	} else {
+		iov.iov_base = (void *)buf;
+		iov.iov_len = size;
+	}
+	memset(&msg, 0, sizeof(msg));
+	memset(&control, 0, sizeof(control));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = CMSG_SPACE(count * sizeof(int));
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+	int *fds = (int *)CMSG_DATA(cmsg);
+	for (int i = 0; i < count; ++i) {
+		fds[i] = descs[i].i32;
+	}
+
+	int retVal = sendmsg(self->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (retVal < 0) {
+		return (errno == EAGAIN || errno == EWOULDBLOCK)? 0 : -1;
+	}
+	return retVal;
+}
+
+int ClientSocket_recvDescriptors(ClientSocket self, unidesc *descs, int *count, uint8_t *buf, int size)
+{
+	if (self == NULL || descs == NULL || count == NULL) return -1;
+	int maxCount = *count;
+	*count = 0;
+	if (self->fd == -1 || self->domain != AF_UNIX) return -1;
+
+	uint8_t dummy;
+	union {
+		char buf[CMSG_SPACE(CLIENT_SOCKET_MAX_DESCRIPTORS * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct iovec iov;
+	struct msghdr msg;
+
+	if (buf == NULL || size <= 0) {
+		iov.iov_base = &dummy;
+		iov.iov_len = 1;
+	} else {
+		iov.iov_base = buf;
+		iov.iov_len = size;
+	}
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	int read_bytes = recvmsg(self->fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+	if (read_bytes == 0) // eof
+		return -1;
+	if (read_bytes < 0) {
+		return (errno == EAGAIN || errno == EWOULDBLOCK)? 0 : -1;
+	}
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+		int num = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+		const int *fds = (const int *)CMSG_DATA(cmsg);
+		for (int i = 0; i < num; ++i) {
+			if (*count < maxCount) {
+				descs[*count].i32 = fds[i];
+				(*count)++;
+			} else {
+				close(fds[i]);
+			}
+		}
+	}
+
+	return read_bytes;
+}
+
 static bool convertAddressToStr(struct sockaddr_storage *addr, ClientSocketAddress address)
 {
 	switch (addr->ss_family) {
@@ -585,6 +1305,15 @@ static bool convertAddressToStr(struct sockaddr_storage *addr, ClientSocketAddre
 			address->port = ntohs(paddr->sin_port);
 			inet_ntop(AF_INET, &(paddr->sin_addr), address->ip, INET_ADDRSTRLEN);
 		} break;
+		case AF_INET6: {
+			struct sockaddr_in6 *paddr = (struct sockaddr_in6*)addr;
+			address->port = ntohs(paddr->sin6_port);
+			if (IN6_IS_ADDR_V4MAPPED(&(paddr->sin6_addr))) {
+				inet_ntop(AF_INET, &(paddr->sin6_addr.s6_addr[12]), address->ip, INET_ADDRSTRLEN);
+			} else {
+				inet_ntop(AF_INET6, &(paddr->sin6_addr), address->ip, INET6_ADDRSTRLEN);
+			}
+		} break;
 		case AF_UNIX: {
 			struct sockaddr_un *paddr = (struct sockaddr_un*)addr;
 			strncpy(address->address, paddr->sun_path, sizeof(address->address)-1);
@@ -607,21 +1336,47 @@ bool ClientUnidesc_getPeerAddress(unidesc ud, ClientSocketAddress address)
 
 bool ClientSocket_getPeerAddress(ClientSocket self, ClientSocketAddress address)
 {
-	if (self == NULL) return false;
-	unidesc ud;
-	ud.i32 = self->fd;
-	return ClientUnidesc_getPeerAddress(ud, address);
+	if (self == NULL || address == NULL) return false;
+	if (self->peerAddrLen == 0) {
+		socklen_t addrLen = sizeof(self->peerAddr);
+		memset(&self->peerAddr, 0, sizeof(self->peerAddr));
+		if (getpeername(self->fd, (struct sockaddr*) &self->peerAddr, &addrLen) != 0) {
+			return false;
+		}
+		self->peerAddrLen = addrLen;
+	}
+	return convertAddressToStr(&self->peerAddr, address);
 }
 
 bool ClientSocket_getLocalAddress(ClientSocket self, ClientSocketAddress address)
 {
 	if (self == NULL || address == NULL) return false;
-	struct sockaddr_storage addr;
-	socklen_t addrLen = sizeof(addr);
-	if (getsockname(self->fd, (struct sockaddr*) &addr, &addrLen) == 0) {
-		return convertAddressToStr(&addr, address);
+	if (self->localAddrLen == 0) {
+		if (self->inreset) {
+			// not bound to the connection yet: do not cache
+			struct sockaddr_storage addr;
+			socklen_t addrLen = sizeof(addr);
+			memset(&addr, 0, sizeof(addr));
+			if (getsockname(self->fd, (struct sockaddr*) &addr, &addrLen) == 0) {
+				return convertAddressToStr(&addr, address);
+			}
+			return false;
+		}
+		socklen_t addrLen = sizeof(self->localAddr);
+		memset(&self->localAddr, 0, sizeof(self->localAddr));
+		if (getsockname(self->fd, (struct sockaddr*) &self->localAddr, &addrLen) != 0) {
+			return false;
+		}
+		self->localAddrLen = addrLen;
 	}
-	return false;
+	return convertAddressToStr(&self->localAddr, address);
+}
+
+bool ClientSocket_getStats(ClientSocket self, HalTcpStats *stats)
+{
+	if (self == NULL || stats == NULL) return false;
+	if (self->fd == -1 || !isInetDomain(self->domain)) return false;
+	return getTcpStats(self->fd, stats);
 }
 
 int ClientSocket_readAvailable(ClientSocket self)
@@ -633,6 +1388,7 @@ int ClientSocket_readAvailable(ClientSocket self)
 void ClientSocket_destroy(ClientSocket self)
 {
 	if (self == NULL) return;
+	ClientSocket_endPollConnect(self);
 	closeAndShutdownSocket(self->fd);
 	self->fd = -1;
 	if (self->server) {
@@ -665,35 +1421,108 @@ void *ClientSocket_getUserData(ClientSocket self)
 }
 
 
-static bool prepareSocketAddress(const char *address, uint16_t port, struct sockaddr_in *sockaddr)
+/*
+ * Numeric addresses are parsed without name resolution. family:
+ *  AF_UNSPEC - any result; AF_INET - IPv4 only;
+ *  AF_INET6 - IPv6 or IPv4 as v4-mapped address (for the dual-stack socket)
+ */
+static bool prepareSocketAddress(const char *address, uint16_t port, int family, struct sockaddr_storage *sockaddr, socklen_t *len)
 {
-	bool retVal = true;
+	struct sockaddr_in *sin = (struct sockaddr_in *)sockaddr;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)sockaddr;
+	struct in_addr v4;
+
+	memset((char *) sockaddr, 0, sizeof(struct sockaddr_storage));
+
+	if (address == NULL) {
+		if (family == AF_INET6) {
+			sin6->sin6_addr = in6addr_any;
+			goto set_inet6;
+		}
+		v4.s_addr = htonl(INADDR_ANY);
+		goto set_inet;
+	}
+
+	if (inet_pton(AF_INET, address, &v4) == 1) {
+		goto set_inet;
+	}
+	if (inet_pton(AF_INET6, address, &(sin6->sin6_addr)) == 1) {
+		goto set_inet6;
+	}
 
-	memset((char *) sockaddr, 0, sizeof(struct sockaddr_in));
+	HalResolver resolver = HalResolver_getSocketResolver();
+	if (resolver) {
+		// no blocking: the name is taken from the cache
+		switch (HalResolver_lookupAddress(resolver, address, family, sockaddr)) {
+			case HAL_RESOLVE_DONE:
+				if (sockaddr->ss_family == AF_INET) {
+					v4 = sin->sin_addr;
+					goto set_inet;
+				}
+				goto set_inet6;
+			case HAL_RESOLVE_PENDING:
+				errno = EWOULDBLOCK;
+				return false;
+			default:
+				return false;
+		}
+	}
 
-	if (address != NULL) {
+	{
 		struct addrinfo addressHints;
 		struct addrinfo *lookupResult;
 		int result;
 
 		memset(&addressHints, 0, sizeof(struct addrinfo));
-		addressHints.ai_family = AF_INET;
+		addressHints.ai_family = (family == AF_INET)? AF_INET : AF_UNSPEC;
+		addressHints.ai_socktype = SOCK_STREAM;
 		result = getaddrinfo(address, NULL, &addressHints, &lookupResult);
 
 		if (result != 0) {
 			return false;
 		}
 
-		memcpy(sockaddr, lookupResult->ai_addr, sizeof(struct sockaddr_in));
+		int found = AF_UNSPEC;
+		for (struct addrinfo *ai = lookupResult; ai; ai = ai->ai_next) {
+			if (ai->ai_family == AF_INET) {
+				v4 = ((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+				found = AF_INET;
+				break;
+			}
+			if (ai->ai_family == AF_INET6 && family != AF_INET) {
+				memcpy(sin6, ai->ai_addr, sizeof(struct sockaddr_in6)); // keeps the scope id
+				found = AF_INET6;
+				break;
+			}
+		}
 		freeaddrinfo(lookupResult);
-	} else {
-		sockaddr->sin_addr.s_addr = htonl(INADDR_ANY);
+
+		if (found == AF_INET) goto set_inet;
+		if (found == AF_INET6) goto set_inet6;
+		return false;
 	}
 
-	sockaddr->sin_family = AF_INET;
-	sockaddr->sin_port = htons(port);
+set_inet:
+	if (family == AF_INET6) {
+		sin6->sin6_addr.s6_addr[10] = 0xff;
+		sin6->sin6_addr.s6_addr[11] = 0xff;
+		memcpy(&(sin6->sin6_addr.s6_addr[12]), &v4, sizeof(v4));
+		goto set_inet6;
+	}
+	sin->sin_family = AF_INET;
+	sin->sin_addr = v4;
+	sin->sin_port = htons(port);
+	*len = sizeof(struct sockaddr_in);
+	return true;
 
-	return retVal;
+set_inet6:
+	if (family == AF_INET) {
+		return false;
+	}
+	sin6->sin6_family = AF_INET6;
+	sin6->sin6_port = htons(port);
+	*len = sizeof(struct sockaddr_in6);
+	return true;
 }
 
 #endif // __linux__
\ No newline at end of file
@@ -1,6 +1,8 @@
 
 #if defined(_WIN32) || defined(_WIN64)
 
+#include "hal_poll_deadline.h"
+#include "hal_resolver.h"
 #include "hal_socket_stream.h"
 #include "hal_thread.h"
 #include "hal_syshelper.h"
@@ -24,6 +26,20 @@ struct sClientSocket {
 	ServerSocket server;
 	int idx;
 	struct sServerClient list;
+	struct sClientSocket *prev;		// previous active client (NULL for first)
+	struct sClientSocket *nextFree;	// next free slot (valid while the slot is free)
+	struct sPollConnect *pconn;		// pending ClientSocket_connectPoll
+	struct sockaddr_storage peerAddr;	// cached at accept/connect
+	int peerAddrLen;				// 0 - not cached (or not connected yet)
+	struct sockaddr_storage localAddr;	// cached at first request
+	int localAddrLen;				// 0 - not cached
+};
+
+struct sPollConnect {
+	HalPoll poll;
+	PollDeadline deadline;		// shared timer of the poll
+	void *user;
+	ClientSocketConnectHandler handler;
 };
 
 struct sClients {
@@ -31,18 +47,38 @@ struct sClients {
 	int size;
 	int maxConnections;
 	struct sClientSocket *self;
+	struct sClientSocket *free;		// stack of the free slots
+	struct sClientSocket *head;		// active clients in accept order
+	struct sClientSocket *tail;
 };
 
 struct sServerSocket {
 	int domain; // SocketType_e
 	SOCKET s;
 	struct sClients clients;
+	bool hasOptions;
+	HalSocketOptions options;		// applied to the accepted clients
 };
 
 
+HAL_INTERNAL HalResolver HalResolver_getSocketResolver(void);
+HAL_INTERNAL HalResolveState HalResolver_lookupAddress(HalResolver self, const char *host, int family, struct sockaddr_storage *sockaddr);
 static bool prepareSocketAddress(const char *address, uint16_t port, struct sockaddr_in *sockaddr);
 
 
+static inline void cacheAddress(struct sockaddr_storage *dst, int *dstLen, const void *addr, int addrLen)
+{
+	memset(dst, 0, sizeof(struct sockaddr_storage));
+	memcpy(dst, addr, addrLen);
+	*dstLen = addrLen;
+}
+
+static inline void clearCachedAddresses(ClientSocket self)
+{
+	self->peerAddrLen = 0;
+	self->localAddrLen = 0;
+}
+
 static inline void setSocketNonBlocking(SOCKET s)
 {
 	u_long val = 1;
@@ -58,6 +94,21 @@ static inline int getSocketAvailableToRead(SOCKET s)
 	return -1;
 }
 
+static void initClientsTable(struct sClients *clients, int maxConnections)
+{
+	clients->maxConnections = maxConnections;
+	clients->size = 0;
+	clients->head = NULL;
+	clients->tail = NULL;
+	clients->free = NULL;
+	for (int i = maxConnections-1; i >= 0; --i) {
+		clients->self[i].s = INVALID_SOCKET;
+		clients->self[i].idx = -1;
+		clients->self[i].nextFree = clients->free;
+		clients->free = &(clients->self[i]);
+	}
+}
+
 
 ServerSocket TcpServerSocket_create(int maxConnections, const char *address, uint16_t port)
 {
@@ -96,8 +147,8 @@ ServerSocket TcpServerSocket_create(int maxConnections, const char *address, uin
 		if (self->clients.self) {
 			self->s = sock;
 			self->domain = (int)ST_Inet;
-			self->clients.maxConnections = maxConnections;
 			self->clients.mu = mu;
+			initClientsTable(&self->clients, maxConnections);
 			setSocketNonBlocking(sock);
 			return self;
 		} else { free(self); }
@@ -110,6 +161,27 @@ exit_error:
 }
 
 
+bool TcpServerSocket_createShards(ServerSocket *shards, int shardsNumber, int maxConnections, const char *address, uint16_t port)
+{
+	if (shards == NULL || shardsNumber <= 0) return false;
+	// windows has no load balancing between listeners
+	if (shardsNumber > 1) return false;
+	shards[0] = TcpServerSocket_create(maxConnections, address, port);
+	return (shards[0] != NULL);
+}
+
+bool TcpServerSocket_activateFastOpen(ServerSocket self, int queueLength)
+{
+	if (self == NULL || self->domain != (int)ST_Inet) return false;
+	#ifdef TCP_FASTOPEN
+	DWORD optval = (queueLength > 0)? 1 : 0;
+	return (setsockopt(self->s, IPPROTO_TCP, TCP_FASTOPEN, (const char *)&optval, sizeof(optval)) == 0);
+	#else
+	return false;
+	#endif
+}
+
+
 ClientSocket TcpClientSocket_createAndBind(const char *ip, uint16_t port)
 {
 	HalShSys_init();
@@ -185,6 +257,70 @@ void TcpClientSocket_setUnacknowledgedTimeout(ClientSocket self, int timeoutInMs
 	if (self == NULL) return;
 }
 
+static bool setIntOption(SOCKET s, int level, int name, int value)
+{
+	return (setsockopt(s, level, name, (const char *)&value, sizeof(value)) == 0);
+}
+
+static bool setBufferOptions(SOCKET s, const HalSocketOptions *options)
+{
+	bool ret = true;
+	if (options->sendBufferSize > 0) ret &= setIntOption(s, SOL_SOCKET, SO_SNDBUF, options->sendBufferSize);
+	if (options->receiveBufferSize > 0) ret &= setIntOption(s, SOL_SOCKET, SO_RCVBUF, options->receiveBufferSize);
+	return ret;
+}
+
+static bool applySocketOptions(SOCKET s, const HalSocketOptions *options)
+{
+	// busy poll, quick ack, not sent low water mark, priority and mark are not supported
+	bool ret = setBufferOptions(s, options);
+	if (options->noDelay) ret &= setIntOption(s, IPPROTO_TCP, TCP_NODELAY, 1);
+	if (options->keepAliveIdle > 0) {
+		ret &= setIntOption(s, SOL_SOCKET, SO_KEEPALIVE, 1);
+		ret &= setIntOption(s, IPPROTO_TCP, TCP_KEEPIDLE, options->keepAliveIdle);
+		if (options->keepAliveInterval > 0) ret &= setIntOption(s, IPPROTO_TCP, TCP_KEEPINTVL, options->keepAliveInterval);
+		if (options->keepAliveCount > 0) ret &= setIntOption(s, IPPROTO_TCP, TCP_KEEPCNT, options->keepAliveCount);
+	}
+	return ret;
+}
+
+bool TcpClientSocket_applyOptions(ClientSocket self, const HalSocketOptions *options)
+{
+	if (self == NULL || options == NULL) return false;
+	return applySocketOptions(self->s, options);
+}
+
+bool TcpServerSocket_setClientOptions(ServerSocket self, const HalSocketOptions *options)
+{
+	if (self == NULL) return false;
+	if (options == NULL) {
+		self->hasOptions = false;
+		return true;
+	}
+	self->options = *options;
+	self->hasOptions = true;
+	return setBufferOptions(self->s, options);
+}
+
+bool TcpClientSocket_activateTls(ClientSocket self, const TcpTlsCryptoInfo *tx, const TcpTlsCryptoInfo *rx)
+{
+	// not supported: no kernel TLS offload
+	(void)self; (void)tx; (void)rx;
+	return false;
+}
+
+int TcpClientSocket_writeTlsRecord(ClientSocket self, uint8_t recordType, const uint8_t *buf, int size)
+{
+	(void)self; (void)recordType; (void)buf; (void)size;
+	return -1;
+}
+
+int TcpClientSocket_readTlsRecord(ClientSocket self, uint8_t *recordType, uint8_t *buf, int size)
+{
+	(void)self; (void)recordType; (void)buf; (void)size;
+	return -1;
+}
+
 
 ServerSocket LocalServerSocket_create(int maxConnections, const char *address)
 {
@@ -231,6 +367,13 @@ ClientSocket LocalClientSocket_create(void)
 }
 
 
+ClientSocket ClientSocket_createFromDescriptor(unidesc ud)
+{
+	(void)ud; // not supported
+	return NULL;
+}
+
+
 void ServerSocket_listen(ServerSocket self, int pending)
 {
 	if (self == NULL) return;
@@ -242,29 +385,44 @@ ClientSocket ServerSocket_accept(ServerSocket self)
 	if (self == NULL) return NULL;
 
 	SOCKET sock;
+	struct sockaddr_storage peerAddr;
+	int peerAddrLen = sizeof(peerAddr);
 
 	ClientSocket conSocket = NULL;
-	sock = accept(self->s, NULL, NULL);
+	memset(&peerAddr, 0, sizeof(peerAddr));
+	sock = accept(self->s, (struct sockaddr *)&peerAddr, &peerAddrLen);
 
 	if (sock != INVALID_SOCKET) {
+		if (self->hasOptions) {
+			applySocketOptions(sock, &self->options);
+		}
 		Mutex_lock(self->clients.mu);
 		{
-			if (self->clients.size >= self->clients.maxConnections) {
+			conSocket = self->clients.free;
+			if (conSocket == NULL) {
 				Mutex_unlock(self->clients.mu);
 				goto exit_error;
 			}
-			for (int i = 0; i < self->clients.maxConnections; ++i) {
-				if ( self->clients.self[i].server == NULL ) {
-					conSocket = &(self->clients.self[i]);
-					conSocket->s = sock;
-					conSocket->domain = self->domain;
-					conSocket->inreset = false;
-					conSocket->server = self;
-					conSocket->idx = i;
-					self->clients.size++;
-					break;
-				}
+			self->clients.free = conSocket->nextFree;
+			conSocket->nextFree = NULL;
+			conSocket->s = sock;
+			conSocket->domain = self->domain;
+			conSocket->inreset = false;
+			conSocket->server = self;
+			conSocket->idx = (int)(conSocket - self->clients.self);
+			cacheAddress(&conSocket->peerAddr, &conSocket->peerAddrLen, &peerAddr, peerAddrLen);
+			conSocket->localAddrLen = 0;
+			// append to the active list
+			conSocket->list.self = conSocket;
+			conSocket->list.next = NULL;
+			conSocket->prev = self->clients.tail;
+			if (self->clients.tail) {
+				self->clients.tail->list.next = &(conSocket->list);
+			} else {
+				self->clients.head = conSocket;
 			}
+			self->clients.tail = conSocket;
+			self->clients.size++;
 		}
 		Mutex_unlock(self->clients.mu);
 	}
@@ -288,34 +446,48 @@ int ServerSocket_getClientsNumber(ServerSocket self)
 ServerClient ServerSocket_getClients(ServerSocket self)
 {
 	ServerClient ret = NULL;
-	ServerClient it = NULL;
 	if (self == NULL) return NULL;
 	Mutex_lock(self->clients.mu);
-	if (self->clients.size > 0) {
-		for (int i = 0; i < self->clients.maxConnections; ++i) {
-			ClientSocket c = &(self->clients.self[i]);
-			if (c->server != NULL) {
-				if (it) it->next = &(c->list);
-				it = &(c->list);
-				it->self = c;
-				it->next = NULL;
-				if (ret == NULL) ret = it;
-			}
-		}
+	if (self->clients.head) {
+		ret = &(self->clients.head->list);
 	}
 	Mutex_unlock(self->clients.mu);
 	return ret;
 }
 
+bool ServerSocket_getStats(ServerSocket self, HalTcpServerStats *stats)
+{
+	// not supported
+	(void)self; (void)stats;
+	return false;
+}
+
 static void ServerSocket_deleteClient(ServerSocket self, ClientSocket client)
 {
 	if (self == NULL || client == NULL) return;
 	if (client->idx >= 0) {
 		Mutex_lock(self->clients.mu);
 		{
+			// unlink from the active list
+			ClientSocket next = (client->list.next)? client->list.next->self : NULL;
+			if (client->prev) {
+				client->prev->list.next = client->list.next;
+			} else {
+				self->clients.head = next;
+			}
+			if (next) {
+				next->prev = client->prev;
+			} else {
+				self->clients.tail = client->prev;
+			}
+			client->list.next = NULL;
+			client->prev = NULL;
+			// return the slot
 			client->inreset = true;
 			client->server = NULL;
 			client->idx = -1;
+			client->nextFree = self->clients.free;
+			self->clients.free = client;
 			self->clients.size--;
 		}
 		Mutex_unlock(self->clients.mu);
@@ -333,13 +505,11 @@ static inline void closeAndShutdownSocket(SOCKET sock)
 void ServerSocket_closeClients(ServerSocket self)
 {
 	Mutex_lock(self->clients.mu);
-	if (self->clients.size > 0) {
-		for (int i = 0; i < self->clients.maxConnections; ++i) {
-			ClientSocket c = &(self->clients.self[i]);
-			if (c->server != NULL) {
-				ServerSocket_deleteClient(self, c);
-			}
-		}
+	ClientSocket c = self->clients.head;
+	while (c != NULL) {
+		ClientSocket next = (c->list.next)? c->list.next->self : NULL;
+		ServerSocket_deleteClient(self, c);
+		c = next;
 	}
 	Mutex_unlock(self->clients.mu);
 }
@@ -386,8 +556,10 @@ bool ClientSocket_connectAsync(ClientSocket self, const ClientSocketAddress addr
 		if (WSAGetLastError() != WSAEWOULDBLOCK) {
 			return false;
 		}
+		// the peer address is cached once the connection is established
+	} else {
+		cacheAddress(&self->peerAddr, &self->peerAddrLen, &serverAddress, sizeof(serverAddress));
 	}
-
 	self->inreset = false;
 	return true; /* is connecting or already connected */
 }
@@ -419,6 +591,101 @@ bool ClientSocket_connect(ClientSocket self, const ClientSocketAddress address,
 	}
 
 	self->inreset = true;
+	clearCachedAddresses(self);
+	return false;
+}
+
+int ClientSocket_connectWithData(ClientSocket self, const ClientSocketAddress address, const uint8_t *buf, int size)
+{
+	if (self == NULL || address == NULL || buf == NULL) return -1;
+	if (self->server || self->domain != (int)ST_Inet) return -1;
+	// fast open requires ConnectEx: use the ordinary connect
+	(void)size;
+	return ClientSocket_connectAsync(self, address)? 0 : -1;
+}
+
+static void ClientSocket_endPollConnect(ClientSocket self)
+{
+	struct sPollConnect *pconn = self->pconn;
+	if (pconn == NULL) return;
+	HalPoll_remove(pconn->poll, ClientSocket_getDescriptor(self));
+	PollDeadline_cancel(&(pconn->deadline));
+	free(pconn);
+	self->pconn = NULL;
+}
+
+static void ClientSocket_completePollConnect(ClientSocket self, ClientSocketState state)
+{
+	struct sPollConnect *pconn = self->pconn;
+	void *user = pconn->user;
+	ClientSocketConnectHandler handler = pconn->handler;
+	ClientSocket_endPollConnect(self);
+	if (state != SOCKET_STATE_CONNECTED) {
+		self->inreset = true;
+		clearCachedAddresses(self);
+	}
+	if (handler) {
+		handler(user, self, state);
+	}
+}
+
+static void onPollConnectEvent(void *user, void *object, int revents)
+{
+	ClientSocket self = (ClientSocket)object;
+	(void)user;
+	(void)revents;
+	if (self->pconn == NULL) return;
+	int so_error = -1;
+	socklen_t len = sizeof(so_error);
+	if (getsockopt(self->s, SOL_SOCKET, SO_ERROR, (char *)&so_error, &len) == 0) {
+		ClientSocket_completePollConnect(self, (so_error == 0)? SOCKET_STATE_CONNECTED : SOCKET_STATE_FAILED);
+	} else {
+		ClientSocket_completePollConnect(self, SOCKET_STATE_FAILED);
+	}
+}
+
+static void onPollConnectTimeout(void *object)
+{
+	ClientSocket self = (ClientSocket)object;
+	if (self->pconn == NULL) return;
+	ClientSocket_completePollConnect(self, SOCKET_STATE_TIMEOUT);
+}
+
+bool ClientSocket_connectPoll(ClientSocket self, const ClientSocketAddress address, HalPoll poll,
+		uint32_t timeoutInMs, void *user, ClientSocketConnectHandler handler)
+{
+	if (self == NULL || address == NULL || poll == NULL) return false;
+	if (self->server || self->pconn) return false;
+
+	struct sPollConnect *pconn = (struct sPollConnect *)calloc(1, sizeof(struct sPollConnect));
+	if (pconn == NULL) return false;
+	pconn->poll = poll;
+	pconn->user = user;
+	pconn->handler = handler;
+
+	if (ClientSocket_connectAsync(self, address) == false) {
+		goto exit_error;
+	}
+
+	self->pconn = pconn;
+	if (!HalPoll_update(poll, ClientSocket_getDescriptor(self), HAL_POLLOUT, self, NULL, onPollConnectEvent)) {
+		goto exit_poll;
+	}
+	if (timeoutInMs) {
+		if (!PollDeadline_start(&(pconn->deadline), poll, timeoutInMs, self, onPollConnectTimeout)) {
+			goto exit_poll;
+		}
+	}
+
+	return true;
+
+exit_poll:
+	ClientSocket_endPollConnect(self);
+	self->inreset = true;
+	clearCachedAddresses(self);
+	return false;
+exit_error:
+	free(pconn);
 	return false;
 }
 
@@ -429,16 +696,19 @@ HAL_INTERNAL void ClientSocket_close(ClientSocket self)
 		closeAndShutdownSocket(self->s);
 		self->s = INVALID_SOCKET;
 		self->inreset = true;
+		clearCachedAddresses(self);
 	}
 }
 
 bool ClientSocket_reset(ClientSocket self)
 {
 	if (self == NULL) return false;
+	ClientSocket_endPollConnect(self);
 	if (self->s != INVALID_SOCKET && self->server == NULL) {
 		closeAndShutdownSocket(self->s);
 		self->s = socket(AF_INET, SOCK_STREAM, 0);
 		self->inreset = true;
+		clearCachedAddresses(self);
 		if (self->s != INVALID_SOCKET) {
 			return true;
 		}
@@ -498,6 +768,30 @@ int ClientSocket_read(ClientSocket self, uint8_t *buf, int size)
 	return read_bytes;
 }
 
+int ClientSocket_receive(ClientSocket self, uint8_t *buf, int size, bool *more)
+{
+	if (more) *more = false;
+	if (self == NULL || buf == NULL) return -1;
+
+	if (self->s == INVALID_SOCKET)
+		return -1;
+
+	int read_bytes = recv(self->s, (char *)buf, size, 0);
+
+	if (read_bytes == 0) // eof
+		return -1;
+
+	if (read_bytes < 0) {
+		switch (WSAGetLastError()) {
+			case WSAEWOULDBLOCK: return 0;
+			default: return -1;
+		}
+	}
+
+	if (more) *more = (read_bytes == size);
+	return read_bytes;
+}
+
 int ClientSocket_write(ClientSocket self, const uint8_t *buf, int size)
 {
 	if (self == NULL || buf == NULL) return -1;
@@ -519,6 +813,20 @@ int ClientSocket_write(ClientSocket self, const uint8_t *buf, int size)
 	return retVal;
 }
 
+int ClientSocket_sendDescriptors(ClientSocket self, const unidesc *descs, int count, const uint8_t *buf, int size)
+{
+	// not supported: local sockets are emulated by TCP
+	(void)self; (void)descs; (void)count; (void)buf; (void)size;
+	return -1;
+}
+
+int ClientSocket_recvDescriptors(ClientSocket self, unidesc *descs, int *count, uint8_t *buf, int size)
+{
+	(void)self; (void)descs; (void)buf; (void)size;
+	if (count) *count = 0;
+	return -1;
+}
+
 static bool convertAddressToStr(struct sockaddr_storage *addr, ClientSocketAddress address)
 {
 	switch (addr->ss_family) {
@@ -535,22 +843,45 @@ static bool convertAddressToStr(struct sockaddr_storage *addr, ClientSocketAddre
 bool ClientSocket_getPeerAddress(ClientSocket self, ClientSocketAddress address)
 {
 	if (self == NULL || address == NULL) return false;
-	struct sockaddr_storage addr;
-	socklen_t addrLen = sizeof(addr);
-	if (getpeername(self->s, (struct sockaddr*) &addr, &addrLen) == 0) {
-		return convertAddressToStr(&addr, address);
+	if (self->peerAddrLen == 0) {
+		int addrLen = sizeof(self->peerAddr);
+		memset(&self->peerAddr, 0, sizeof(self->peerAddr));
+		if (getpeername(self->s, (struct sockaddr*) &self->peerAddr, &addrLen) != 0) {
+			return false;
+		}
+		self->peerAddrLen = addrLen;
 	}
-	return false;
+	return convertAddressToStr(&self->peerAddr, address);
 }
 
 bool ClientSocket_getLocalAddress(ClientSocket self, ClientSocketAddress address)
 {
 	if (self == NULL || address == NULL) return false;
-	struct sockaddr_storage addr;
-	socklen_t addrLen = sizeof(addr);
-	if (getsockname(self->s, (struct sockaddr*) &addr, &addrLen) == 0) {
-		return convertAddressToStr(&addr, address);
+	if (self->localAddrLen == 0) {
+		if (self->inreset) {
+			// not bound to the connection yet: do not cache
+			struct sockaddr_storage addr;
+			int addrLen = sizeof(addr);
+			memset(&addr, 0, sizeof(addr));
+			if (getsockname(self->s, (struct sockaddr*) &addr, &addrLen) == 0) {
+				return convertAddressToStr(&addr, address);
+			}
+			return false;
+		}
+		int addrLen = sizeof(self->localAddr);
+		memset(&self->localAddr, 0, sizeof(self->localAddr));
+		if (getsockname(self->s, (struct sockaddr*) &self->localAddr, &addrLen) != 0) {
+			return false;
+		}
+		self->localAddrLen = addrLen;
 	}
+	return convertAddressToStr(&self->localAddr, address);
+}
+
+bool ClientSocket_getStats(ClientSocket self, HalTcpStats *stats)
+{
+	// not supported
+	(void)self; (void)stats;
 	return false;
 }
 
@@ -563,6 +894,7 @@ int ClientSocket_readAvailable(ClientSocket self)
 void ClientSocket_destroy(ClientSocket self)
 {
 	if (self == NULL) return;
+	ClientSocket_endPollConnect(self);
 	closeAndShutdownSocket(self->s);
 	self->s = INVALID_SOCKET;
 	if (self->server) {
@@ -590,6 +922,23 @@ static bool prepareSocketAddress(const char *address, uint16_t port, struct sock
 
 	memset((char *) sockaddr, 0, sizeof(struct sockaddr_in));
 
+	HalResolver resolver = HalResolver_getSocketResolver();
+	if (address != NULL && resolver != NULL && inet_pton(AF_INET, address, &(sockaddr->sin_addr)) != 1) {
+		// no blocking: the name is taken from the cache
+		struct sockaddr_storage resolved;
+		switch (HalResolver_lookupAddress(resolver, address, AF_INET, &resolved)) {
+			case HAL_RESOLVE_DONE:
+				memcpy(sockaddr, &resolved, sizeof(struct sockaddr_in));
+				sockaddr->sin_port = htons(port);
+				return true;
+			case HAL_RESOLVE_PENDING:
+				WSASetLastError(WSAEWOULDBLOCK);
+				return false;
+			default:
+				return false;
+		}
+	}
+
 	if (address != NULL) {
 		struct addrinfo addressHints;
 		struct addrinfo *lookupResult;
@@ -41,4 +41,15 @@ uint64_t Hal_getMonotonicTimeInMs(void)
 	return ((uint64_t)tv.tv_sec*1000L) + (uint64_t)tv.tv_nsec/1000000L;
 }
 
+uint64_t Hal_getMonotonicTimeInNs(void)
+{
+	struct timespec tv;
+	#ifdef CLOCK_BOOTTIME
+	clock_gettime(CLOCK_BOOTTIME, &tv);
+	#else
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	#endif
+	return ((uint64_t)tv.tv_sec*1000000000L) + (uint64_t)tv.tv_nsec;
+}
+
 #endif // __linux__
\ No newline at end of file
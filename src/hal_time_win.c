@@ -33,4 +33,16 @@ uint64_t Hal_getMonotonicTimeInMs(void)
 	return (uint64_t)((Time.QuadPart * 1000) / Frequency.QuadPart);
 }
 
+uint64_t Hal_getMonotonicTimeInNs(void)
+{
+	LARGE_INTEGER Time;
+	LARGE_INTEGER Frequency;
+	QueryPerformanceFrequency(&Frequency);
+	QueryPerformanceCounter(&Time);
+	// split to avoid the overflow
+	uint64_t sec = (uint64_t)(Time.QuadPart / Frequency.QuadPart);
+	uint64_t rem = (uint64_t)(Time.QuadPart % Frequency.QuadPart);
+	return sec * 1000000000ULL + (rem * 1000000000ULL) / (uint64_t)Frequency.QuadPart;
+}
+
 #endif // _WIN32 || _WIN64
\ No newline at end of file
@@ -0,0 +1,138 @@
+
+#include <stdio.h>
+#include "hal_crc.h"
+#include "hal_time.h"
+
+#define err() printf("%s:%d\n", __FILE__, __LINE__)
+
+// bit by bit reference
+static uint32_t crcRef(uint32_t poly, uint32_t crc, const uint8_t *p, size_t size)
+{
+	while (size--) {
+		crc ^= *p++;
+		for (int i = 0; i < 8; ++i) {
+			crc = (crc & 1)? (crc >> 1) ^ poly : (crc >> 1);
+		}
+	}
+	return crc;
+}
+
+// byte by byte table: what the framing code did before
+static uint32_t byteTable[256];
+
+static uint32_t crc32Bytewise(uint32_t crc, const uint8_t *p, size_t size)
+{
+	crc = ~crc;
+	while (size--) {
+		crc = (crc >> 8) ^ byteTable[(crc ^ *p++) & 0xFF];
+	}
+	return ~crc;
+}
+
+static double speed(uint64_t ns, size_t size, int rounds)
+{
+	return (double)size * rounds * 1000.0 / (double)ns; // MB/s
+}
+
+int main(int argc, const char **argv)
+{
+	int test = 0;
+	test = atoi(argv[1]);
+	const char *check = "123456789";
+	static uint8_t buf[1 << 16];
+	uint32_t seed = 12345;
+	for (size_t i = 0; i < sizeof(buf); ++i) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = (uint8_t)(seed >> 16);
+	}
+	switch (test) {
+		case 1: { // check values
+			for (int hw = 0; hw < 2; ++hw) {
+				HalCrc_setHardware(hw == 1);
+				if (HalCrc_crc16(HAL_CRC16_MODBUS_INIT, check, 9) != 0x4B37) { err(); return 1; }
+				if (HalCrc_crc16(HAL_CRC16_IBM_INIT, check, 9) != 0xBB3D) { err(); return 1; }
+				if (HalCrc_crc32(0, check, 9) != 0xCBF43926) { err(); return 1; }
+				if (HalCrc_crc32c(0, check, 9) != 0xE3069283) { err(); return 1; }
+				if (HalCrc_crc32(0, check, 0) != 0) { err(); return 1; }
+				if (HalCrc_crc32c(0x1234, NULL, 10) != 0x1234) { err(); return 1; }
+				// modbus frame: read holding registers, crc low byte first
+				const uint8_t frame[8] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0xC5, 0xCD };
+				if (HalCrc_crc16(HAL_CRC16_MODBUS_INIT, frame, 6) != 0xCDC5) { err(); return 1; }
+				if (HalCrc_crc16(HAL_CRC16_MODBUS_INIT, frame, 8) != 0) { err(); return 1; }
+			}
+			return 0;
+		} break;
+		case 2: { // all lengths and alignments, by parts
+			for (int hw = 0; hw < 2; ++hw) {
+				HalCrc_setHardware(hw == 1);
+				for (size_t off = 0; off < 16; ++off) {
+					for (size_t len = 0; len < 600; len += (len < 140)? 1 : 37) {
+						const uint8_t *p = buf + off;
+						uint32_t r16 = crcRef(0xA001, 0xFFFF, p, len);
+						uint32_t r32 = ~crcRef(0xEDB88320, 0xFFFFFFFF, p, len);
+						uint32_t r32c = ~crcRef(0x82F63B78, 0xFFFFFFFF, p, len);
+						if (HalCrc_crc16(0xFFFF, p, len) != r16) { err(); return 1; }
+						if (HalCrc_crc32(0, p, len) != r32) { err(); return 1; }
+						if (HalCrc_crc32c(0, p, len) != r32c) { err(); return 1; }
+						size_t half = len / 3;
+						if (HalCrc_crc16(HalCrc_crc16(0xFFFF, p, half), p + half, len - half) != r16) { err(); return 1; }
+						if (HalCrc_crc32(HalCrc_crc32(0, p, half), p + half, len - half) != r32) { err(); return 1; }
+						if (HalCrc_crc32c(HalCrc_crc32c(0, p, half), p + half, len - half) != r32c) { err(); return 1; }
+					}
+				}
+			}
+			// large
+			uint32_t r32 = ~crcRef(0xEDB88320, 0xFFFFFFFF, buf, sizeof(buf));
+			uint32_t r32c = ~crcRef(0x82F63B78, 0xFFFFFFFF, buf, sizeof(buf));
+			for (int hw = 0; hw < 2; ++hw) {
+				HalCrc_setHardware(hw == 1);
+				if (HalCrc_crc32(0, buf, sizeof(buf)) != r32) { err(); return 1; }
+				if (HalCrc_crc32c(0, buf, sizeof(buf)) != r32c) { err(); return 1; }
+			}
+			return 0;
+		} break;
+		case 3: { // benchmark: bytewise table, slicing-by-8, cpu instructions
+			static const size_t sizes[] = { 8, 256, 1500, 65536 };
+			for (uint32_t b = 0; b < 256; ++b) {
+				uint32_t c = b;
+				for (int i = 0; i < 8; ++i) c = (c & 1)? (c >> 1) ^ 0xEDB88320 : (c >> 1);
+				byteTable[b] = c;
+			}
+			bool hw = HalCrc_setHardware(true);
+			printf("cpu instructions: %s\n", (hw)? "yes" : "no");
+			volatile uint32_t sink = 0;
+			for (int s = 0; s < 4; ++s) {
+				size_t size = sizes[s];
+				int rounds = (int)((64 << 20) / size);
+				uint64_t ts0, tb, t16, t32, t32c, t32hw, t32chw;
+				ts0 = Hal_getMonotonicTimeInNs();
+				for (int i = 0; i < rounds; ++i) sink += crc32Bytewise(0, buf, size);
+				tb = Hal_getMonotonicTimeInNs() - ts0;
+				HalCrc_setHardware(false);
+				ts0 = Hal_getMonotonicTimeInNs();
+				for (int i = 0; i < rounds; ++i) sink += HalCrc_crc16(0xFFFF, buf, size);
+				t16 = Hal_getMonotonicTimeInNs() - ts0;
+				ts0 = Hal_getMonotonicTimeInNs();
+				for (int i = 0; i < rounds; ++i) sink += HalCrc_crc32(0, buf, size);
+				t32 = Hal_getMonotonicTimeInNs() - ts0;
+				ts0 = Hal_getMonotonicTimeInNs();
+				for (int i = 0; i < rounds; ++i) sink += HalCrc_crc32c(0, buf, size);
+				t32c = Hal_getMonotonicTimeInNs() - ts0;
+				HalCrc_setHardware(true);
+				ts0 = Hal_getMonotonicTimeInNs();
+				for (int i = 0; i < rounds; ++i) sink += HalCrc_crc32(0, buf, size);
+				t32hw = Hal_getMonotonicTimeInNs() - ts0;
+				ts0 = Hal_getMonotonicTimeInNs();
+				for (int i = 0; i < rounds; ++i) sink += HalCrc_crc32c(0, buf, size);
+				t32chw = Hal_getMonotonicTimeInNs() - ts0;
+				printf("%6u bytes, MB/s: crc32 bytewise %7.0f, slice8 %7.0f, hw %7.0f | crc32c slice8 %7.0f, hw %7.0f | crc16 slice8 %7.0f\n",
+						(unsigned)size, speed(tb, size, rounds), speed(t32, size, rounds), speed(t32hw, size, rounds),
+						speed(t32c, size, rounds), speed(t32chw, size, rounds), speed(t16, size, rounds));
+			}
+			(void)sink;
+			return 0;
+		} break;
+	}
+
+	{ err(); return 1; }
+}
@@ -1,7 +1,9 @@
 
 #include <stdio.h>
+#include <errno.h>
 #include "hal_socket_dgram.h"
 #include "hal_poll.h"
+#include "hal_resolver.h"
 #include "hal_thread.h"
 #include "hal_time.h"
 #include "hal_utils.h"
@@ -277,6 +279,135 @@ int main(int argc, const char **argv)
 			DgramSocket_destroy(s3);
 			return 0;
 		} break;
+		case 7: { // udp receive without readAvailable
+			int full;
+			s1 = UdpDgramSocket_createAndBind("127.0.0.1", 43555);
+			s2 = UdpDgramSocket_createAndBind("127.0.0.1", 43556);
+			s3 = UdpDgramSocket_createAndBind("127.0.0.1", 43557);
+			strcpy(addr.ip, "127.0.0.1");
+			addr.port = 43556;
+			DgramSocket_setRemote(s1, &addr);
+			DgramSocket_setRemote(s3, &addr);
+			addr.port = 43555;
+			DgramSocket_setRemote(s2, &addr);
+			// nothing
+			rc = DgramSocket_receive(s2, buf, 1000, &full);
+			if (rc != 0 || full != 0) { err(); return 1; }
+			// write
+			for (int i = 0; i < 65535; ++i) {
+				buf[i] = (char)i;
+			}
+			rc = DgramSocket_write(s3, buf+1000, 1000);
+			if (rc != 1000) { err(); return 1; }
+			rc = DgramSocket_write(s1, buf, 1000);
+			if (rc != 1000) { err(); return 1; }
+			rc = DgramSocket_write(s1, buf, 1000);
+			if (rc != 1000) { err(); return 1; }
+			HalThread_sleep(10);
+			// read: s3 is dropped
+			memset(buf, 0, 65535);
+			rc = DgramSocket_receive(s2, buf, 1000, &full);
+			if (rc != 1000 || full != 1000) { err(); return 1; }
+			for (int i = 0; i < 1000; ++i) {
+				if (buf[i] != (char)i) { err(); return 1; }
+			}
+			// truncated
+			rc = DgramSocket_receiveFrom(s2, &addr, buf, 100, &full);
+			if (rc != 100 || full != 1000) { err(); return 1; }
+			if (addr.port != 43555) { err(); return 1; }
+			rc = DgramSocket_receiveFrom(s2, &addr, buf, 100, &full);
+			if (rc != 0 || full != 0) { err(); return 1; }
+			// clean
+			DgramSocket_destroy(s1);
+			DgramSocket_destroy(s2);
+			DgramSocket_destroy(s3);
+			return 0;
+		} break;
+		case 8: { // udp ipv6 and dual-stack
+			int full;
+			s1 = UdpDgramSocket_createAndBind("::1", 43555);
+			s2 = UdpDgramSocket_createAndBind("::", 43556);
+			s3 = UdpDgramSocket_createAndBind("127.0.0.1", 43557);
+			if (s1 == NULL || s2 == NULL || s3 == NULL) { err(); return 1; }
+			strcpy(addr.ip, "::1");
+			addr.port = 43556;
+			DgramSocket_setRemote(s1, &addr);
+			strcpy(addr.ip, "127.0.0.1");
+			DgramSocket_setRemote(s3, &addr);
+			strcpy(addr.ip, "0:0::1");
+			addr.port = 43555;
+			DgramSocket_setRemote(s2, &addr);
+			// write
+			for (int i = 0; i < 65535; ++i) {
+				buf[i] = (char)i;
+			}
+			rc = DgramSocket_write(s3, buf+1000, 1000);
+			if (rc != 1000) { err(); return 1; }
+			rc = DgramSocket_write(s1, buf, 1000);
+			if (rc != 1000) { err(); return 1; }
+			HalThread_sleep(10);
+			// ipv4 source
+			memset(buf, 0, 65535);
+			rc = DgramSocket_receiveFrom(s2, &addr, buf, 1000, &full);
+			if (rc != 1000) { err(); return 1; }
+			if (strcmp(addr.ip, "127.0.0.1") != 0 || addr.port != 43557) { err(); return 1; }
+			// ipv6 source is the remote
+			rc = DgramSocket_readAvailable(s2, true);
+			if (rc != 1000) { err(); return 1; }
+			rc = DgramSocket_read(s2, buf, 1000);
+			if (rc != 1000) { err(); return 1; }
+			for (int i = 0; i < 1000; ++i) {
+				if (buf[i] != (char)i) { err(); return 1; }
+			}
+			// reply
+			rc = DgramSocket_write(s2, buf, 100);
+			if (rc != 100) { err(); return 1; }
+			HalThread_sleep(10);
+			rc = DgramSocket_readFrom(s1, &addr, buf, 1000);
+			if (rc != 100) { err(); return 1; }
+			if (strcmp(addr.ip, "::1") != 0 || addr.port != 43556) { err(); return 1; }
+			// bind of IPv4 socket to IPv6 address: the socket is kept
+			DgramSocket s4 = UdpDgramSocket_create();
+			unidesc ud = DgramSocket_getDescriptor(s4);
+			if (UdpDgramSocket_bind(s4, "::1", 43558) == true) { err(); return 1; }
+			if (DgramSocket_getDescriptor(s4).i32 != ud.i32) { err(); return 1; }
+			DgramSocket_destroy(s4);
+			// clean
+			DgramSocket_destroy(s1);
+			DgramSocket_destroy(s2);
+			DgramSocket_destroy(s3);
+			return 0;
+		} break;
+		case 9: { // udp remote name by the socket resolver
+			HalResolver r = HalResolver_create(2, 10000);
+			if (r == NULL) { err(); return 1; }
+			HalResolver_setSocketResolver(r);
+			s1 = UdpDgramSocket_createAndBind("127.0.0.1", 43555);
+			s2 = UdpDgramSocket_create();
+			if (s1 == NULL || s2 == NULL) { err(); return 1; }
+			// localhost has IPv4 and IPv6 addresses: the IPv4 one is taken for the IPv4 socket
+			strcpy(addr.ip, "localhost");
+			addr.port = 43555;
+			DgramSocket_setRemote(s2, &addr);
+			rc = DgramSocket_write(s2, (uint8_t *)buf, 100);
+			if (rc == -1) { // the name is pending (the resolution may be finished already)
+				if (errno != EWOULDBLOCK) { err(); return 1; }
+				rc = Hal_pollSingle(HalResolver_getDescriptor(r), HAL_POLLIN, NULL, 1000);
+				if (rc != 1) { err(); return 1; }
+				HalResolver_endEvent(r);
+				rc = DgramSocket_write(s2, (uint8_t *)buf, 100);
+			}
+			if (rc != 100) { err(); return 1; }
+			HalThread_sleep(10);
+			rc = DgramSocket_readFrom(s1, &addr, buf, 1000);
+			if (rc != 100) { err(); return 1; }
+			// clean
+			DgramSocket_destroy(s2);
+			DgramSocket_destroy(s1);
+			HalResolver_setSocketResolver(NULL);
+			HalResolver_destroy(r);
+			return 0;
+		} break;
 		case 10: { // local base
 			// link
 			LocalDgramSocket_unlinkAddress("/tmp/local-d-test0");
@@ -1,12 +1,111 @@
 
 #include <stdio.h>
 #include "hal_serial.h"
+#include "hal_serial_master.h"
 #include "hal_poll.h"
 #include "hal_time.h"
 #include "hal_thread.h"
 
 #define err() printf("%s:%d\n", __FILE__, __LINE__)
 
+static char frames[100];
+
+static int txCompleted = 0;
+static int rxCount = 0;
+
+static void onTxComplete(void *user, SerialPort port)
+{
+	(void)user; (void)port;
+	txCompleted++;
+}
+
+static int slaveRequests = 0;
+static int masterResults[8];
+static int masterSizes[8];
+static int masterDone = 0;
+
+// answers 5 bytes to the 8 bytes requests except the ones to the address 0xFF
+static void onSlaveEvent(void *user, void *object, int revents)
+{
+	static uint8_t req[64];
+	static int cnt = 0;
+	(void)user; (void)revents;
+	int rc = SerialPort_readBulk((SerialPort)object, req + cnt, sizeof(req) - cnt);
+	if (rc <= 0) return;
+	cnt += rc;
+	if (cnt < 8) return;
+	slaveRequests++;
+	if (req[0] != 0xFF) {
+		uint8_t resp[5] = { req[0], req[1], 0x02, 0xAA, 0x55 };
+		SerialPort_write((SerialPort)object, resp, 5);
+	}
+	cnt = 0;
+}
+
+static void onMasterResult(void *user, SerialPort port, SerialMasterResult result, const uint8_t *response, int size)
+{
+	(void)port;
+	int idx = (int)(intptr_t)user;
+	masterResults[idx] = result;
+	masterSizes[idx] = size;
+	if (result == SERIAL_MASTER_OK && size == 5 && (response[0] != idx || response[4] != 0x55)) {
+		masterSizes[idx] = -1;
+	}
+	masterDone++;
+}
+
+static void onRxEvent(void *user, void *object, int revents)
+{
+	(void)revents;
+	int rc = SerialPort_readBulk((SerialPort)object, (uint8_t *)user + rxCount, 65535);
+	if (rc > 0) rxCount += rc;
+}
+
+static void *frameWriter(void *parameter)
+{
+	SerialPort s = (SerialPort)parameter;
+	HalThread_sleep(10);
+	SerialPort_write(s, (uint8_t *)frames, 10);
+	HalThread_sleep(1);
+	SerialPort_write(s, (uint8_t *)frames+10, 20);
+	HalThread_sleep(30);
+	SerialPort_write(s, (uint8_t *)frames+30, 50);
+	return NULL;
+}
+
+// frames/s and latency (from the write to the read completion) of the pty pair line
+static int benchLine(SerialPort tx, SerialPort rx, int baudRate, int frames, bool byGap, bool simulated)
+{
+	uint8_t frame[16];
+	uint8_t in[64];
+	uint64_t sum = 0, max = 0;
+	if (SerialPort_reinit(tx, baudRate, 8, 'N', 1) == false) return -1;
+	if (SerialPort_reinit(rx, baudRate, 8, 'N', 1) == false) return -1;
+	if (SerialPort_open(tx) == false || SerialPort_open(rx) == false) return -1;
+	SerialPort_discardInBuffer(rx);
+	uint64_t wire = (uint64_t)sizeof(frame) * 10 * 1000000000ULL / (uint64_t)baudRate;
+	uint64_t t0 = Hal_getMonotonicTimeInNs();
+	for (int i = 0; i < frames; ++i) {
+		memset(frame, i, sizeof(frame));
+		uint64_t ts0 = Hal_getMonotonicTimeInNs();
+		if (SerialPort_write(tx, frame, sizeof(frame)) != (int)sizeof(frame)) return -1;
+		int rc = (byGap)?
+				SerialPort_readFrame(rx, in, sizeof(in), NULL) :
+				SerialPort_read(rx, in, sizeof(frame));
+		uint64_t lat = Hal_getMonotonicTimeInNs() - ts0;
+		if (rc != (int)sizeof(frame) || memcmp(in, frame, sizeof(frame)) != 0) return -1;
+		sum += lat;
+		if (lat > max) max = lat;
+	}
+	uint64_t total = Hal_getMonotonicTimeInNs() - t0;
+	printf("%-9s %8d baud %-5s: %8.0f frames/s, latency avg %7.1f us, max %7.1f us (wire %6.1f us)\n",
+			(simulated)? "simulated" : "raw", baudRate, (byGap)? "gap" : "read",
+			frames * 1e9 / (double)total, sum / 1e3 / frames, max / 1e3, wire / 1e3);
+	// the line can not be faster than the wire
+	if (simulated && sum / frames < wire * 9 / 10) return -1;
+	return 0;
+}
+
 int main(int argc, const char **argv)
 {
 	int test = 0;
@@ -23,8 +122,14 @@ int main(int argc, const char **argv)
 #endif
 	int rc, revents;
 	uint64_t ts, ts0;
-	SerialPort s1 = SerialPort_create(com1);
-	SerialPort s2 = SerialPort_create(com2);
+	SerialPort s1, s2;
+	if (test >= 11) {
+		// no hardware: pty pair
+		if (SerialPort_createPtyPair(&s1, &s2, test == 12) == false) { err(); return 1; }
+	} else {
+		s1 = SerialPort_create(com1);
+		s2 = SerialPort_create(com2);
+	}
 	if (SerialPort_reinit(s1, 115200, 8, 'N', 1) == false) { err(); return 1; }
 	if (SerialPort_reinit(s2, 115200, 8, 'N', 1) == false) { err(); return 1; }
 	SerialPort_setTimeout(s1, 100);
@@ -90,7 +195,7 @@ int main(int argc, const char **argv)
 			// write
 			rc = SerialPort_write(s1, buf, 257);
 			if (rc != 257) { err(); return 1; }
-			Thread_sleep(10); // wait for bytes
+			HalThread_sleep(10); // wait for bytes
 			SerialPort_discardInBuffer(s2);
 			// read (timeout)
 			ts0 = Hal_getTimeInMs();
@@ -172,6 +277,418 @@ int main(int argc, const char **argv)
 			SerialPort_destroy(s2);
 			return 0;
 		} break;
+		case 5: { // bulk read
+			// nothing (timeout)
+			ts0 = Hal_getTimeInMs();
+			rc = SerialPort_readBulk(s2, buf, 1000);
+			ts = Hal_getTimeInMs() - ts0;
+			if (rc != 0) { err(); return 1; }
+			if (ts < 80 || ts > 120) { err(); return 1; }
+			// write
+			rc = SerialPort_write(s1, buf, 257);
+			if (rc != 257) { err(); return 1; }
+			memset(buf, 0, 257);
+			// read all in chunks
+			ts0 = Hal_getTimeInMs();
+			int cnt = 0;
+			while (cnt < 257) {
+				rc = SerialPort_readBulk(s2, buf + cnt, 1000);
+				if (rc <= 0) { err(); return 1; }
+				cnt += rc;
+			}
+			ts = Hal_getTimeInMs() - ts0;
+			if (cnt != 257) { err(); return 1; }
+			if (ts > 20) { err(); return 1; }
+			// compare
+			for (int i = 0; i < 257; ++i) {
+				if (buf[i] != (char)i) { err(); return 1; }
+			}
+			// closed
+			SerialPort_close(s2);
+			if (SerialPort_readBulk(s2, buf, 1000) != -1) { err(); return 1; }
+			// clean
+			SerialPort_destroy(s1);
+			SerialPort_destroy(s2);
+			return 0;
+		} break;
+		case 6: { // frames by gap
+			uint64_t fts1, fts2;
+			SerialPort s3 = SerialPort_create(com1);
+			SerialPort_reinit(s3, 9600, 8, 'N', 1);
+			if (SerialPort_getFrameGap(s3) != 3646) { err(); return 1; }
+			SerialPort_reinit(s3, 9600, 8, 'E', 1);
+			if (SerialPort_getFrameGap(s3) != 4011) { err(); return 1; }
+			SerialPort_destroy(s3);
+			if (SerialPort_getFrameGap(s2) != 1750) { err(); return 1; }
+			SerialPort_setFrameGap(s2, 5000); // pty jitter
+			for (int i = 0; i < 100; ++i) {
+				frames[i] = (char)(i * 7);
+			}
+			if (SerialPort_getFrameGap(s2) != 5000) { err(); return 1; }
+			// nothing (timeout)
+			ts0 = Hal_getTimeInMs();
+			rc = SerialPort_readFrame(s2, buf, 1000, &fts1);
+			ts = Hal_getTimeInMs() - ts0;
+			if (rc != 0) { err(); return 1; }
+			if (ts < 80 || ts > 120) { err(); return 1; }
+			// two frames
+			Thread th = HalThread_create(0, frameWriter, s1, false);
+			HalThread_start(th);
+			char rbuf[100];
+			rc = SerialPort_readFrame(s2, rbuf, 100, &fts1);
+			if (rc != 30 || memcmp(rbuf, frames, 30) != 0) { err(); return 1; }
+			// truncated
+			rc = SerialPort_readFrame(s2, rbuf, 40, &fts2);
+			if (rc != 40 || memcmp(rbuf, frames+30, 40) != 0) { err(); return 1; }
+			if (fts2 - fts1 < 25000000ULL) { err(); return 1; }
+			// the rest is discarded
+			rc = SerialPort_readBulk(s2, rbuf, 100);
+			if (rc != 0) { err(); return 1; }
+			// clean
+			HalThread_destroy(th);
+			SerialPort_destroy(s1);
+			SerialPort_destroy(s2);
+			return 0;
+		} break;
+		case 7: { // custom baud rate and latency
+			if (SerialPort_reinit(s1, 250000, 8, 'N', 1) == false) { err(); return 1; }
+			if (SerialPort_reinit(s2, 250000, 8, 'N', 1) == false) { err(); return 1; }
+			SerialPort_setLowLatency(s2, true); // pty: not supported, ignored
+			if (SerialPort_open(s1) == false) { err(); return 1; }
+			if (SerialPort_open(s2) == false) { err(); return 1; }
+			if (SerialPort_getLastError(s1) != SERIAL_PORT_ERROR_NONE) { err(); return 1; }
+			if (SerialPort_getBaudRate(s1) != 250000) { err(); return 1; }
+			// no usb adapter
+			if (SerialPort_setLatencyTimer(s2, 1) == true) { err(); return 1; }
+			if (SerialPort_setLatencyTimer(s2, 0) == true) { err(); return 1; }
+			// write
+			rc = SerialPort_write(s1, buf, 257);
+			if (rc != 257) { err(); return 1; }
+			memset(buf, 0, 257);
+			rc = SerialPort_read(s2, buf, 257);
+			if (rc != 257) { err(); return 1; }
+			for (int i = 0; i < 257; ++i) {
+				if (buf[i] != (char)i) { err(); return 1; }
+			}
+			// invalid
+			if (SerialPort_reinit(s1, 0, 8, 'N', 1) == false) { err(); return 1; }
+			if (SerialPort_open(s1) == true) { err(); return 1; }
+			if (SerialPort_getLastError(s1) != SERIAL_PORT_ERROR_INVALID_BAUDRATE) { err(); return 1; }
+			// clean
+			SerialPort_destroy(s1);
+			SerialPort_destroy(s2);
+			return 0;
+		} break;
+		case 8: { // transmit queue
+			static char rbuf[65535];
+			HalPoll p = HalPoll_create(8);
+			if (SerialPort_attachTxQueue(s1, p, 30000, NULL, onTxComplete) == false) { err(); return 1; }
+			if (!HalPoll_update(p, SerialPort_getDescriptor(s2), HAL_POLLIN, s2, rbuf, onRxEvent)) { err(); return 1; }
+			for (int i = 0; i < 40000; ++i) {
+				buf[i] = (char)(i * 13);
+			}
+			// too long for the queue
+			if (SerialPort_writeAsync(s1, buf, 40000) != 0) { err(); return 1; }
+			// does not block
+			ts0 = Hal_getTimeInMs();
+			if (SerialPort_writeAsync(s1, buf, 20000) != 20000) { err(); return 1; }
+			if (SerialPort_writeAsync(s1, buf+20000, 5000) != 5000) { err(); return 1; }
+			if (Hal_getTimeInMs() - ts0 > 10) { err(); return 1; }
+			// drain
+			ts0 = Hal_getTimeInMs();
+			while (txCompleted == 0 && Hal_getTimeInMs() - ts0 < 2000) {
+				HalPoll_wait(p, 10);
+			}
+			if (txCompleted != 1) { err(); return 1; }
+			if (SerialPort_getTxPending(s1) != 0) { err(); return 1; }
+			while (rxCount < 25000 && Hal_getTimeInMs() - ts0 < 2000) {
+				HalPoll_wait(p, 10);
+			}
+			if (rxCount != 25000 || memcmp(rbuf, buf, 25000) != 0) { err(); return 1; }
+			// completion once per transmission
+			HalPoll_wait(p, 20);
+			if (txCompleted != 1) { err(); return 1; }
+			// clean
+			HalPoll_remove(p, SerialPort_getDescriptor(s2));
+			SerialPort_destroy(s1);
+			SerialPort_destroy(s2);
+			HalPoll_destroy(p);
+			return 0;
+		} break;
+		case 9: { // rs485
+			SerialPortRs485 rs;
+			memset(&rs, 0, sizeof(rs));
+			rs.enabled = true;
+			rs.rtsOnSend = true;
+			rs.delayAfterSendInMs = 1;
+			// pty has no rs485 support
+			if (SerialPort_setRs485(s1, &rs) == true) { err(); return 1; }
+			if (SerialPort_reinit(s1, 115200, 8, 'N', 1) == false) { err(); return 1; }
+			if (SerialPort_setRs485(s1, &rs) == false) { err(); return 1; }
+			if (SerialPort_open(s1) == true) { err(); return 1; }
+			if (SerialPort_getLastError(s1) != SERIAL_PORT_ERROR_INVALID_ARGUMENT) { err(); return 1; }
+			// rs232
+			rs.enabled = false;
+			if (SerialPort_setRs485(s1, &rs) == false) { err(); return 1; }
+			if (SerialPort_open(s1) == false) { err(); return 1; }
+			// clean
+			SerialPort_destroy(s1);
+			SerialPort_destroy(s2);
+			return 0;
+		} break;
+		case 10: { // serial master
+			HalPoll p = HalPoll_create(8);
+			SerialMaster m = SerialMaster_create(p);
+			if (m == NULL) { err(); return 1; }
+			SerialPort_setFrameGap(s1, 5000); // pty jitter
+			SerialPort_setTimeout(s2, 0);
+			if (SerialMaster_addPort(m, s1, 4) == false) { err(); return 1; }
+			if (SerialMaster_addPort(m, s1, 4) == true) { err(); return 1; }
+			if (!HalPoll_update(p, SerialPort_getDescriptor(s2), HAL_POLLIN, s2, NULL, onSlaveEvent)) { err(); return 1; }
+			uint8_t rq[8] = { 0, 3, 0, 0, 0, 1, 0, 0 };
+			// queued: expected size, gap, timeout with retry, broadcast
+			rq[0] = 0;
+			if (!SerialMaster_request(m, s1, rq, 8, 5, 100, 0, (void *)0, onMasterResult)) { err(); return 1; }
+			rq[0] = 1;
+			if (!SerialMaster_request(m, s1, rq, 8, 0, 100, 0, (void *)1, onMasterResult)) { err(); return 1; }
+			rq[0] = 0xFF;
+			if (!SerialMaster_request(m, s1, rq, 8, 0, 50, 1, (void *)2, onMasterResult)) { err(); return 1; }
+			rq[0] = 0xFF;
+			if (!SerialMaster_request(m, s1, rq, 8, 0, 0, 0, (void *)3, onMasterResult)) { err(); return 1; }
+			if (SerialMaster_request(m, s1, rq, 8, 0, 0, 0, (void *)4, onMasterResult)) { err(); return 1; }
+			if (SerialMaster_getQueued(m, s1) != 4) { err(); return 1; }
+			ts0 = Hal_getTimeInMs();
+			while (masterDone < 4 && Hal_getTimeInMs() - ts0 < 1000) {
+				HalPoll_wait(p, 10);
+			}
+			ts = Hal_getTimeInMs() - ts0;
+			if (masterDone != 4) { err(); return 1; }
+			if (masterResults[0] != SERIAL_MASTER_OK || masterSizes[0] != 5) { err(); return 1; }
+			if (masterResults[1] != SERIAL_MASTER_OK || masterSizes[1] != 5) { err(); return 1; }
+			if (masterResults[2] != SERIAL_MASTER_TIMEOUT) { err(); return 1; }
+			if (masterResults[3] != SERIAL_MASTER_OK || masterSizes[3] != 0) { err(); return 1; }
+			if (slaveRequests != 5) { err(); return 1; } // with the retry
+			if (ts < 100 || ts > 200) { err(); return 1; }
+			// cancel
+			rq[0] = 0xFF;
+			if (!SerialMaster_request(m, s1, rq, 8, 0, 100, 0, (void *)5, onMasterResult)) { err(); return 1; }
+			SerialMaster_removePort(m, s1);
+			if (masterDone != 5 || masterResults[5] != SERIAL_MASTER_CANCELLED) { err(); return 1; }
+			if (SerialMaster_getQueued(m, s1) != -1) { err(); return 1; }
+			// clean
+			SerialMaster_destroy(m);
+			HalPoll_remove(p, SerialPort_getDescriptor(s2));
+			SerialPort_destroy(s1);
+			SerialPort_destroy(s2);
+			HalPoll_destroy(p);
+			return 0;
+		} break;
+		case 11: { // pty pair
+			if (SerialPort_createPtyPair(NULL, &s2, false) == true) { err(); return 1; }
+			if (Hal_unidescIsInvalid(SerialPort_getDescriptor(s1))) { err(); return 1; }
+			// both directions
+			rc = SerialPort_write(s1, buf, 257);
+			if (rc != 257) { err(); return 1; }
+			rc = SerialPort_read(s2, buf + 300, 257);
+			if (rc != 257 || memcmp(buf, buf + 300, 257) != 0) { err(); return 1; }
+			rc = SerialPort_write(s2, buf, 100);
+			if (rc != 100) { err(); return 1; }
+			rc = SerialPort_read(s1, buf + 300, 257);
+			if (rc != 100 || memcmp(buf, buf + 300, 100) != 0) { err(); return 1; }
+			// raw: no line discipline
+			uint8_t ctl[4] = { '\n', '\r', 0x03, 0x04 };
+			if (SerialPort_write(s1, ctl, 4) != 4) { err(); return 1; }
+			if (SerialPort_read(s2, (uint8_t *)buf + 300, 4) != 4 || memcmp(ctl, buf + 300, 4) != 0) { err(); return 1; }
+			// still connected after reinit
+			if (SerialPort_reinit(s2, 250000, 8, 'E', 1) == false) { err(); return 1; }
+			if (SerialPort_open(s2) == false) { err(); return 1; }
+			if (SerialPort_write(s1, buf, 10) != 10) { err(); return 1; }
+			if (SerialPort_read(s2, buf + 300, 10) != 10) { err(); return 1; }
+			// timeout
+			ts0 = Hal_getTimeInMs();
+			rc = SerialPort_readBulk(s2, buf, 10);
+			ts = Hal_getTimeInMs() - ts0;
+			if (rc != 0 || ts < 80 || ts > 120) { err(); return 1; }
+			// clean
+			SerialPort_destroy(s1);
+			SerialPort_destroy(s2);
+			return 0;
+		} break;
+		case 12: { // benchmark on the simulated line
+			static const int rates[] = { 9600, 115200, 921600 };
+			static const int frames[] = { 20, 100, 200 };
+			for (int i = 0; i < 3; ++i) {
+				if (benchLine(s1, s2, rates[i], frames[i], false, true) != 0) { err(); return 1; }
+				if (benchLine(s1, s2, rates[i], frames[i] / 4, true, true) != 0) { err(); return 1; }
+			}
+			SerialPort_destroy(s1);
+			SerialPort_destroy(s2);
+			// the code path only
+			if (SerialPort_createPtyPair(&s1, &s2, false) == false) { err(); return 1; }
+			if (benchLine(s1, s2, 115200, 2000, false, false) != 0) { err(); return 1; }
+			if (benchLine(s1, s2, 115200, 200, true, false) != 0) { err(); return 1; }
+			SerialPort_destroy(s1);
+			SerialPort_destroy(s2);
+			return 0;
+		} break;
+		case 13: { // receive ring
+			const uint8_t *seg;
+			uint64_t t1, t2;
+			HalPoll p = HalPoll_create(4);
+			if (SerialPort_peekRxRing(s2, &seg, NULL) != -1) { err(); return 1; }
+			if (SerialPort_startRxRing(s2, 100) == false) { err(); return 1; }
+			if (SerialPort_startRxRing(s2, 100) == true) { err(); return 1; }
+			unidesc rd = SerialPort_getRxRingDescriptor(s2);
+			if (Hal_unidescIsInvalid(rd)) { err(); return 1; }
+			if (!HalPoll_update_1(p, rd, HAL_POLLIN)) { err(); return 1; }
+			if (SerialPort_read(s2, buf, 10) != -1) { err(); return 1; }
+			if (SerialPort_peekRxRing(s2, &seg, NULL) != 0) { err(); return 1; }
+			if (HalPoll_wait(p, 10) != 0) { err(); return 1; }
+			// two chunks: kept apart while the application is busy
+			if (SerialPort_write(s1, buf, 10) != 10) { err(); return 1; }
+			HalThread_sleep(20);
+			if (SerialPort_write(s1, buf + 10, 20) != 20) { err(); return 1; }
+			HalThread_sleep(20);
+			if (HalPoll_wait(p, 100) != 1) { err(); return 1; }
+			if (SerialPort_peekRxRing(s2, &seg, &t1) != 10 || memcmp(seg, buf, 10) != 0) { err(); return 1; }
+			SerialPort_consumeRxRing(s2, 10);
+			if (SerialPort_peekRxRing(s2, &seg, &t2) != 20 || memcmp(seg, buf + 10, 20) != 0) { err(); return 1; }
+			if (t2 - t1 < 15000000ULL) { err(); return 1; }
+			SerialPort_consumeRxRing(s2, 5);
+			if (SerialPort_peekRxRing(s2, &seg, &t1) != 15 || t1 != t2 || seg[0] != 15) { err(); return 1; }
+			SerialPort_consumeRxRing(s2, 15);
+			if (SerialPort_peekRxRing(s2, &seg, NULL) != 0) { err(); return 1; }
+			if (HalPoll_wait(p, 10) != 0) { err(); return 1; }
+			// more than the ring (128): split at the end, the rest waits in the driver
+			for (int i = 0; i < 300; ++i) buf[i] = (char)i;
+			if (SerialPort_write(s1, buf, 300) != 300) { err(); return 1; }
+			int cnt = 0;
+			ts0 = Hal_getTimeInMs();
+			while (cnt < 300 && Hal_getTimeInMs() - ts0 < 1000) {
+				if (HalPoll_wait(p, 100) != 1) { err(); return 1; }
+				while ((rc = SerialPort_peekRxRing(s2, &seg, NULL)) > 0) {
+					if (rc > 128 || memcmp(seg, buf + cnt, rc) != 0) { err(); return 1; }
+					cnt += rc;
+					SerialPort_consumeRxRing(s2, rc);
+				}
+				if (rc < 0) { err(); return 1; }
+			}
+			if (cnt != 300) { err(); return 1; }
+			// hang up
+			SerialPort_destroy(s1);
+			if (HalPoll_wait(p, 100) != 1) { err(); return 1; }
+			if (SerialPort_peekRxRing(s2, &seg, NULL) != -1) { err(); return 1; }
+			// clean
+			SerialPort_stopRxRing(s2);
+			if (SerialPort_peekRxRing(s2, &seg, NULL) != -1) { err(); return 1; }
+			HalPoll_destroy(p);
+			SerialPort_destroy(s2);
+			return 0;
+		} break;
+		case 14: { // capture
+			const char *path = "test_serial.pcapng";
+			if (SerialPort_startCapture(s1, "/nonexistent/test.pcapng") == true) { err(); return 1; }
+			if (SerialPort_startCapture(s1, path) == false) { err(); return 1; }
+			if (SerialPort_startCapture(s1, path) == true) { err(); return 1; }
+			if (SerialPort_write(s1, (uint8_t *)"abc", 3) != 3) { err(); return 1; }
+			if (SerialPort_read(s2, buf, 3) != 3) { err(); return 1; }
+			HalThread_sleep(5);
+			if (SerialPort_write(s2, (uint8_t *)"12345", 5) != 5) { err(); return 1; }
+			if (SerialPort_read(s1, buf, 5) != 5) { err(); return 1; }
+			// written directly by the transmit queue
+			HalPoll p = HalPoll_create(4);
+			if (SerialPort_attachTxQueue(s1, p, 64, NULL, NULL) == false) { err(); return 1; }
+			if (SerialPort_writeAsync(s1, (uint8_t *)"qw", 2) != 2) { err(); return 1; }
+			if (SerialPort_read(s2, buf, 2) != 2) { err(); return 1; }
+			SerialPort_detachTxQueue(s1);
+			HalPoll_destroy(p);
+			SerialPort_stopCapture(s1);
+			if (SerialPort_write(s1, (uint8_t *)"x", 1) != 1) { err(); return 1; } // not captured
+			// parse
+			FILE *f = fopen(path, "rb");
+			if (f == NULL) { err(); return 1; }
+			int size = (int)fread(buf, 1, 4096, f);
+			fclose(f);
+			remove(path);
+			uint32_t blk[8];
+			int off = 0, epb = 0;
+			uint64_t prev = 0;
+			uint64_t now = Hal_getTimeInMs() * 1000000ULL;
+			while (off + 12 <= size) {
+				memcpy(blk, buf + off, 8);
+				int len = (int)blk[1];
+				if (len < 12 || off + len > size) { err(); return 1; }
+				uint8_t *body = (uint8_t *)buf + off + 8;
+				if (off == 0 && blk[0] != 0x0A0D0D0A) { err(); return 1; }
+				if (blk[0] == 1 && *(uint16_t *)body != 147) { err(); return 1; }
+				if (blk[0] == 6) {
+					memcpy(blk, body, 20);
+					uint64_t ts = ((uint64_t)blk[1] << 32) | blk[2];
+					uint32_t flags;
+					memcpy(&flags, body + 20 + ((blk[3] + 3) & ~3u) + 4, 4);
+					if (ts < prev || ts > now || now - ts > 10000000000ULL) { err(); return 1; }
+					prev = ts;
+					if (epb == 0 && (blk[3] != 3 || memcmp(body + 20, "abc", 3) != 0 || flags != 2)) { err(); return 1; }
+					if (epb == 1 && (blk[3] != 5 || memcmp(body + 20, "12345", 5) != 0 || flags != 1)) { err(); return 1; }
+					if (epb == 2 && (blk[3] != 2 || memcmp(body + 20, "qw", 2) != 0 || flags != 2)) { err(); return 1; }
+					epb++;
+				}
+				off += len;
+			}
+			if (off != size || epb != 3) { err(); return 1; }
+			// clean
+			SerialPort_destroy(s1);
+			SerialPort_destroy(s2);
+			return 0;
+		} break;
+		case 15: { // serial master: short write and hang-up on the pty pair
+			HalPoll p = HalPoll_create(8);
+			SerialMaster m = SerialMaster_create(p);
+			if (SerialMaster_addPort(m, s1, 4) == false) { err(); return 1; }
+			SerialPort_setTimeout(s2, 0);
+			// fill the driver buffer
+			uint8_t rq[8] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88 };
+			memset(buf, 0, 256);
+			for (int i = 0; i < 5; ++i) { // the pty moves the data to the slave side in background
+				HalThread_sleep(10);
+				while (SerialPort_write(s1, (uint8_t *)buf, 256) > 0) {}
+			}
+			if (!SerialMaster_request(m, s1, rq, 8, 0, 100, 0, (void *)0, onMasterResult)) { err(); return 1; }
+			HalPoll_wait(p, 20);
+			if (masterDone != 0) { err(); return 1; }
+			// the rest is written when the slave reads
+			uint8_t last[8] = { 0 };
+			ts0 = Hal_getTimeInMs();
+			while (Hal_getTimeInMs() - ts0 < 1000) {
+				while ((rc = SerialPort_readBulk(s2, buf + 300, 256)) > 0) {
+					for (int i = 0; i < rc; ++i) {
+						memmove(last, last + 1, 7);
+						last[7] = buf[300 + i];
+					}
+				}
+				if (masterDone == 1 && memcmp(last, rq, 8) == 0) break;
+				HalPoll_wait(p, 5);
+			}
+			if (memcmp(last, rq, 8) != 0) { err(); return 1; }
+			if (masterDone != 1 || masterResults[0] != SERIAL_MASTER_TIMEOUT) { err(); return 1; } // no slave
+			// hang-up
+			if (!SerialMaster_request(m, s1, rq, 8, 0, 1000, 0, (void *)1, onMasterResult)) { err(); return 1; }
+			if (!SerialMaster_request(m, s1, rq, 8, 0, 1000, 0, (void *)2, onMasterResult)) { err(); return 1; }
+			SerialPort_destroy(s2);
+			ts0 = Hal_getTimeInMs();
+			while (masterDone < 3 && Hal_getTimeInMs() - ts0 < 500) {
+				HalPoll_wait(p, 10);
+			}
+			if (masterDone != 3) { err(); return 1; }
+			if (masterResults[1] != SERIAL_MASTER_ERROR || masterResults[2] != SERIAL_MASTER_ERROR) { err(); return 1; }
+			if (SerialMaster_request(m, s1, rq, 8, 0, 1000, 0, (void *)3, onMasterResult)) { err(); return 1; }
+			if (HalPoll_size(p) != 1) { err(); return 1; } // the timer only
+			// clean
+			SerialMaster_destroy(m);
+			SerialPort_destroy(s1);
+			HalPoll_destroy(p);
+			return 0;
+		} break;
 	}
 
 	{ err(); return 1; }
@@ -10,6 +10,7 @@ add_executable(test_thread tests/test_thread.c)
 add_executable(test_stream tests/test_stream.c)
 add_executable(test_dgram tests/test_dgram.c)
 add_executable(test_serial tests/test_serial.c)
+add_executable(test_crc tests/test_crc.c)
 
 target_link_libraries(test_base PUBLIC libhal)
 target_link_libraries(test_utils PUBLIC libhal)
@@ -22,6 +23,7 @@ target_link_libraries(test_thread PUBLIC libhal)
 target_link_libraries(test_stream PUBLIC libhal)
 target_link_libraries(test_dgram PUBLIC libhal)
 target_link_libraries(test_serial PUBLIC libhal)
+target_link_libraries(test_crc PUBLIC libhal)
 
 
 
@@ -91,9 +93,24 @@ add_test(test_stream_tacpt2con test_stream 2)
 add_test(test_stream_tclbind test_stream 3)
 add_test(test_stream_tsyncon test_stream 4)
 add_test(test_stream_tcl2con test_stream 5)
+add_test(test_stream_tslots test_stream 6)
+add_test(test_stream_tshards test_stream 7)
+add_test(test_stream_tpollcon test_stream 8)
+add_test(test_stream_tpool test_stream 9)
+add_test(test_stream_tfopen test_stream 10)
+add_test(test_stream_framer test_stream 11)
+add_test(test_stream_trecv test_stream 12)
+add_test(test_stream_taddr test_stream 13)
+add_test(test_stream_tipv6 test_stream 14)
+add_test(test_stream_resolver test_stream 15)
+add_test(test_stream_ktls test_stream 16)
+add_test(test_stream_topts test_stream 17)
+add_test(test_stream_tstats test_stream 18)
 add_test(test_stream_lclbase test_stream 100)
 add_test(test_stream_lacpt2con test_stream 101)
 add_test(test_stream_lcl2con test_stream 102)
+add_test(test_stream_lshm test_stream 103)
+add_test(test_stream_lfdpass test_stream 104)
 
 add_test(test_dgram_ubase test_dgram 1)
 add_test(test_dgram_ureuse test_dgram 2)
@@ -102,6 +119,9 @@ add_test(test_dgram_urst test_dgram 3)
 add_test(test_dgram_mcast test_dgram 4)
 add_test(test_dgram_udesc test_dgram 5)
 add_test(test_dgram_upfilt test_dgram 6)
+add_test(test_dgram_urecv test_dgram 7)
+add_test(test_dgram_uipv6 test_dgram 8)
+add_test(test_dgram_uresolv test_dgram 9)
 add_test(test_dgram_lbase test_dgram 10)
 add_test(test_dgram_lrst test_dgram 11)
 add_test(test_dgram_ldesc test_dgram 12)
@@ -117,3 +137,18 @@ add_test(test_serial_base test_serial 1)
 add_test(test_serial_disc test_serial 2)
 add_test(test_serial_reinit test_serial 3)
 add_test(test_serial_desc test_serial 4)
+add_test(test_serial_bulk test_serial 5)
+add_test(test_serial_frame test_serial 6)
+add_test(test_serial_baud test_serial 7)
+add_test(test_serial_txqueue test_serial 8)
+add_test(test_serial_rs485 test_serial 9)
+add_test(test_serial_master test_serial 10)
+add_test(test_serial_pty test_serial 11)
+add_test(test_serial_bench test_serial 12)
+add_test(test_serial_rxring test_serial 13)
+add_test(test_serial_capture test_serial 14)
+add_test(test_serial_masterhup test_serial 15)
+
+add_test(test_crc_check test_crc 1)
+add_test(test_crc_parts test_crc 2)
+add_test(test_crc_bench test_crc 3)